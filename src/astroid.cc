@@ -42,10 +42,13 @@
 # endif
 
 # include "poll.hh"
+# include "crypto.hh"
+# include "outbox.hh"
 
 /* UI */
 # include "main_window.hh"
 # include "modes/thread_index/thread_index.hh"
+# include "modes/thread_view/thread_view.hh"
 # include "modes/edit_message.hh"
 # include "modes/saved_searches.hh"
 
@@ -321,6 +324,18 @@ namespace Astroid {
       }
       poll = new Poll (!no_auto_poll);
 
+      /* set up crypto workers */
+      crypto_worker   = new CryptoWorker ();
+      decrypted_cache = new DecryptedCache ();
+      key_cache       = new KeyCache ();
+
+      if (config ().get<bool> ("crypto.gpg.cache_signatures")) {
+        SignatureCache::prune ();
+      }
+
+      /* set up outbox, sends messages left from last session */
+      outbox = new Outbox ();
+
       Gtk::Application::run (argc, argv);
 
       on_quit ();
@@ -381,6 +396,11 @@ namespace Astroid {
 
     /* set up poller */
     poll = new Poll (false);
+
+    /* set up crypto workers */
+    crypto_worker   = new CryptoWorker ();
+    decrypted_cache = new DecryptedCache ();
+    key_cache       = new KeyCache ();
   } // }}}
 
   bool Astroid::in_test () {
@@ -393,7 +413,12 @@ namespace Astroid {
     if (poll && poll->get_auto_poll ()) poll->toggle_auto_poll  ();
     if (poll) poll->close ();
 
+    if (outbox) outbox->close ();
     if (actions) actions->close ();
+    if (crypto_worker) crypto_worker->close ();
+    if (decrypted_cache) decrypted_cache->clear ();
+    if (key_cache) key_cache->clear ();
+    ThreadView::clear_pool ();
     SavedSearches::destruct ();
 
 # ifndef DISABLE_PLUGINS
@@ -418,6 +443,18 @@ namespace Astroid {
       actions->close ();
       delete actions;
     }
+
+    if (crypto_worker) {
+      crypto_worker->close ();
+      delete crypto_worker;
+    }
+
+    if (decrypted_cache) delete decrypted_cache;
+    if (key_cache) delete key_cache;
+
+    if (outbox) delete outbox;
+
+    Crypto::release_contexts ();
   }
 
   int Astroid::on_command_line (const refptr<Gio::ApplicationCommandLine> & cmd) {
@@ -508,6 +545,9 @@ namespace Astroid {
       mw->set_active (0);
     }
 
+    /* have a thread view ready when the first thread is opened */
+    ThreadView::fill_pool ();
+
     mw->signal_delete_event ().connect (
         sigc::bind (
           sigc::mem_fun(*this, &Astroid::on_window_close), mw));
@@ -75,6 +75,14 @@ namespace Astroid {
       /* poll */
       Poll * poll;
 
+      /* queue of outgoing messages */
+      Outbox * outbox = NULL;
+
+      /* deferred crypto operations */
+      CryptoWorker * crypto_worker = NULL;
+      DecryptedCache * decrypted_cache = NULL;
+      KeyCache * key_cache = NULL;
+
       MainWindow * open_new_window (bool open_defaults = true);
 
       int hint_level ();
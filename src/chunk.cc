@@ -24,19 +24,52 @@ namespace Astroid {
 
   std::atomic<uint> Chunk::nextid (0);
 
-  Chunk::Chunk (GMimeObject * mp, bool encrypted, bool _signed, refptr<Crypto> _cr) : mime_object (mp) {
+  const Chunk::ViewableType Chunk::viewable_types[] = {
+    { "plain", "text", "plain" },
+    { "html",  "text", "html"  },
+    { NULL,    NULL,   NULL    },
+  };
+
+  const Chunk::ViewableType * Chunk::get_viewable_type (ustring name) {
+    for (const ViewableType * v = viewable_types; v->name != NULL; v++) {
+      if (name == v->name) return v;
+    }
+
+    return NULL;
+  }
+
+  Chunk::Options::Options () :
+    preferred_type (get_viewable_type (astroid->config().get<std::string>("thread_view.preferred_type")))
+  {
+  }
+
+  Chunk::Chunk (GMimeObject * mp, bool encrypted, bool _signed, refptr<Crypto> _cr) :
+    Chunk (mp, Options (), "0", encrypted, _signed, _cr)
+  {
+  }
+
+  Chunk::Chunk (GMimeObject * mp, const Options & _options) :
+    Chunk (mp, _options, "0", false, false, refptr<Crypto> ())
+  {
+  }
+
+  Chunk::Chunk (GMimeObject * mp, const Options & _options, ustring _part_id, bool encrypted, bool _signed, refptr<Crypto> _cr) :
+    mime_object (mp),
+    options (_options),
+    part_id (_part_id)
+  {
     id = nextid++;
 
+    options.defer_crypto = options.defer_crypto && astroid->crypto_worker && astroid->crypto_worker->enabled ();
+
     isencrypted = encrypted;
     issigned    = _signed;
     crypt       = _cr;
 
-    ustring pts = astroid->config().get<std::string>("thread_view.preferred_type");
-    if (pts != "plain" && pts != "html") {
+    if (options.preferred_type == NULL) {
       LOG (error) << "chunk: preferred type not 'html' or 'plain', setting to 'plain'.";
-      pts = "plain";
+      options.preferred_type = get_viewable_type ("plain");
     }
-    preferred_type = viewable_types[pts];
 
     if (mp == NULL) {
       LOG (error) << "chunk (" << id << "): got NULL mime_object.";
@@ -73,11 +106,8 @@ namespace Astroid {
           /* check if we can show this type */
           viewable = false;
 
-          for (auto &m : viewable_types) {
-            if (g_mime_content_type_is_type (content_type,
-                  g_mime_content_type_get_media_type (m.second),
-                  g_mime_content_type_get_media_subtype (m.second))) {
-
+          for (const ViewableType * v = viewable_types; v->name != NULL; v++) {
+            if (g_mime_content_type_is_type (content_type, v->type, v->subtype)) {
               viewable = true;
               break;
             }
@@ -90,8 +120,8 @@ namespace Astroid {
       attachment = !viewable;
 
       if (g_mime_content_type_is_type (content_type,
-          g_mime_content_type_get_media_type (preferred_type),
-          g_mime_content_type_get_media_subtype (preferred_type)))
+          options.preferred_type->type,
+          options.preferred_type->subtype))
       {
         LOG (debug) << "chunk: preferred.";
         preferred = true;
@@ -119,7 +149,7 @@ namespace Astroid {
 
       /* contains a GMimeMessage with a potential substructure */
       GMimeMessage * msg = g_mime_message_part_get_message ((GMimeMessagePart *) mime_object);
-      kids.push_back (refptr<Chunk>(new Chunk((GMimeObject *) msg)));
+      add_kid (refptr<Chunk>(new Chunk((GMimeObject *) msg, options, part_id + ".0", false, false, refptr<Crypto> ())));
 
     } else if GMIME_IS_MESSAGE_PARTIAL (mime_object) {
       LOG (debug) << "chunk: partial";
@@ -129,7 +159,7 @@ namespace Astroid {
           g_mime_message_partial_get_total ((GMimeMessagePartial *) mime_object)
           );
 
-      kids.push_back (refptr<Chunk>(new Chunk((GMimeObject *) msg)));
+      add_kid (refptr<Chunk>(new Chunk((GMimeObject *) msg, options, part_id + ".0", false, false, refptr<Crypto> ())));
 
 
     } else if GMIME_IS_MULTIPART (mime_object) {
@@ -159,16 +189,26 @@ namespace Astroid {
             return;
           }
 
-          GMimeObject * k = crypt->decrypt_and_verify (mime_object);
+          ustring cache_key = "";
+          if (!options.mid.empty ()) {
+            cache_key = options.mid + "/" + part_id;
+          }
 
-          if (k != NULL) {
-            auto c = refptr<Chunk>(new Chunk(k, true, crypt->verify_tried, crypt));
-            kids.push_back (c);
-          } else {
-            /* will be displayed as failed decrypted part */
-            viewable = true;
+          bool cached = !cache_key.empty () &&
+                        astroid->decrypted_cache &&
+                        astroid->decrypted_cache->contains (cache_key);
+
+          if (options.defer_crypto && !cached) {
+            /* displayed as pending part until decrypted */
+            viewable  = true;
             preferred = true;
 
+            crypt->signal_done ().connect (
+                sigc::mem_fun (this, &Chunk::on_crypto_done));
+            crypt->decrypt_and_verify_async (mime_object, cache_key);
+
+          } else {
+            add_decrypted (crypt->decrypt_and_verify (mime_object, cache_key));
           }
 
       } else if (GMIME_IS_MULTIPART_SIGNED (mime_object) && crypt->ready) {
@@ -180,10 +220,16 @@ namespace Astroid {
               (GMimeMultipart *) mime_object,
               0);
 
-          crypt->verify_signature (mime_object);
+          if (options.defer_crypto) {
+            crypt->signal_done ().connect (
+                sigc::mem_fun (this, &Chunk::on_crypto_done));
+            crypt->verify_signature_async (mime_object);
+
+          } else {
+            crypt->verify_signature (mime_object);
+          }
 
-          auto c = refptr<Chunk>(new Chunk(mo, false, true, crypt));
-          kids.push_back (c);
+          add_kid (refptr<Chunk>(new Chunk(mo, options, part_id + ".0", false, true, crypt)));
 
       } else {
 
@@ -191,13 +237,14 @@ namespace Astroid {
         LOG (debug) << "chunk: alternative: " << alternative;
 
 
+        kids.reserve (total);
+
         for (int i = 0; i < total; i++) {
           GMimeObject * mo = g_mime_multipart_get_part (
               (GMimeMultipart *) mime_object,
               i);
 
-          auto c = refptr<Chunk>(new Chunk(mo, isencrypted, issigned, crypt));
-          kids.push_back (c);
+          add_kid (refptr<Chunk>(new Chunk(mo, options, ustring::compose ("%1.%2", part_id, i), isencrypted, issigned, crypt)));
         }
 
         if (alternative) {
@@ -217,8 +264,8 @@ namespace Astroid {
                   );
 
                 if (g_mime_content_type_is_type (c->content_type,
-                    g_mime_content_type_get_media_type (preferred_type),
-                    g_mime_content_type_get_media_subtype (preferred_type)))
+                    options.preferred_type->type,
+                    options.preferred_type->subtype))
                 {
                   LOG (debug) << "chunk: multipart: preferred.";
                   c->preferred = true;
@@ -238,11 +285,71 @@ namespace Astroid {
 
   }
 
+  void Chunk::add_kid (refptr<Chunk> c) {
+    if (options.defer_crypto) {
+      /* pass on completed crypto operations to the root chunk */
+      c->signal_crypto_done ().connect (
+          sigc::mem_fun (this, &Chunk::emit_crypto_done));
+    }
+
+    kids.push_back (c);
+  }
+
+  void Chunk::add_decrypted (GMimeObject * k) {
+    if (k != NULL) {
+      viewable  = false;
+      preferred = false;
+
+      add_kid (refptr<Chunk>(new Chunk(k, options, part_id + ".0", true, crypt->verify_tried, crypt)));
+    } else {
+      /* will be displayed as failed decrypted part */
+      viewable = true;
+      preferred = true;
+
+    }
+  }
+
+  void Chunk::on_crypto_done () {
+    LOG (debug) << "chunk (" << id << "): crypto done.";
+
+    if (isencrypted) {
+      add_decrypted (crypt->take_decrypted ());
+    }
+
+    emit_crypto_done ();
+  }
+
+  void Chunk::wait_for_crypto () {
+    if (crypt && crypt->pending) {
+      crypt->wait ();
+    }
+
+    for (auto &k : kids) {
+      k->wait_for_crypto ();
+    }
+  }
+
+  Chunk::type_signal_crypto_done Chunk::signal_crypto_done () {
+    return m_signal_crypto_done;
+  }
+
+  void Chunk::emit_crypto_done () {
+    m_signal_crypto_done.emit ();
+  }
+
   bool Chunk::is_content_type (const char * major, const char * minor) {
     return (mime_object != NULL) && g_mime_content_type_is_type (content_type, major, minor);
   }
 
-  ustring Chunk::viewable_text (bool html = true, bool verbose) {
+  ustring Chunk::viewable_text (bool html = true, bool verbose, ustring_sz max_length) {
+    if (isencrypted && crypt->pending) {
+      if (verbose) {
+        return "Decrypting..";
+      } else {
+        return "";
+      }
+    }
+
     if (isencrypted && !crypt->decrypted) {
       if (verbose) {
       /* replace newlines */
@@ -380,10 +487,30 @@ namespace Astroid {
       ssize_t prevn = 1;
       ssize_t n;
       std::stringstream sstr;
+      ustring_sz chars = 0;
 
       while ((n = g_mime_stream_read (content_stream, buffer, 4096), n) >= 0)
       {
         buffer[n] = 0;
+
+        if (max_length != ustring::npos) {
+          /* count UTF-8 lead bytes and cut at the first character beyond
+           * max_length, the rest of the stream is never decoded. */
+          ssize_t i = 0;
+          for (; i < n; i++) {
+            if ((buffer[i] & 0xc0) != 0x80) {
+              if (chars == max_length) break;
+              chars++;
+            }
+          }
+
+          if (i < n) {
+            buffer[i] = 0;
+            sstr << buffer;
+            break;
+          }
+        }
+
         sstr << buffer;
 
         if (n == 0 && prevn == 0) {
@@ -699,6 +826,10 @@ namespace Astroid {
 
   Chunk::~Chunk () {
     LOG (debug) << "chunk: deconstruct.";
+
+    /* nobody is interested in the result anymore */
+    if (crypt && crypt->pending) crypt->cancel ();
+
     // these should not be unreffed.
     if (mime_object) g_object_unref (mime_object);
     // g_object_unref (content_type);
@@ -1,7 +1,6 @@
 # pragma once
 
 # include <vector>
-# include <map>
 # include <atomic>
 # include <string>
 
@@ -19,9 +18,39 @@ namespace Astroid {
       static std::atomic<uint> nextid;
 
     public:
+      /* content types that can be displayed, shared by all chunks */
+      struct ViewableType {
+        const char * name;
+        const char * type;
+        const char * subtype;
+      };
+
+      static const ViewableType viewable_types[];
+      static const ViewableType * get_viewable_type (ustring name);
+
+      /* loading options, set for the root chunk and passed on to the kids */
+      struct Options {
+        Options (); // preferred type from config
+
+        const ViewableType * preferred_type;
+
+        /* queue decryption and verification on the crypto workers, see
+         * signal_crypto_done () */
+        bool    defer_crypto = false;
+
+        /* message id, used to look up decrypted parts in the cache */
+        ustring mid;
+      };
+
       Chunk (GMimeObject *, bool encrypted = false, bool _signed = false, refptr<Crypto> _cr = refptr<Crypto> ());
+      Chunk (GMimeObject *, const Options &);
       ~Chunk ();
 
+    protected:
+      /* used for sub-parts, part_id is the path of the part in the message */
+      Chunk (GMimeObject *, const Options &, ustring part_id, bool encrypted, bool _signed, refptr<Crypto> _cr);
+
+    public:
       int id;
 
       /* Chunk assumes ownership of these */
@@ -32,7 +61,9 @@ namespace Astroid {
       ustring get_content_type ();
       bool    is_content_type (const char* major, const char* minor);
 
-      ustring viewable_text (bool, bool verbose = false);
+      /* decoded text of this part, if max_length is set decoding stops once
+       * max_length characters have been produced. */
+      ustring viewable_text (bool, bool verbose = false, ustring_sz max_length = ustring::npos);
 
       std::vector<refptr<Chunk>> kids;
       std::vector<refptr<Chunk>> siblings;
@@ -50,15 +81,29 @@ namespace Astroid {
 
       refptr<Message> get_mime_message ();
 
-      std::map<ustring, GMimeContentType *> viewable_types = {
-        { "plain", g_mime_content_type_new ("text", "plain") },
-        { "html" , g_mime_content_type_new ("text", "html") }
-      };
-
-      GMimeContentType * preferred_type;
+      Options options;
+      ustring part_id;
 
       refptr<Crypto> crypt;
 
+      /* finish any deferred crypto operations in this chunk and its kids */
+      void wait_for_crypto ();
+
+      /* emitted on the GUI thread when a deferred crypto operation in this
+       * chunk or any of its kids has finished */
+      typedef sigc::signal <void> type_signal_crypto_done;
+      type_signal_crypto_done signal_crypto_done ();
+
+    protected:
+      void add_kid (refptr<Chunk>);
+      void add_decrypted (GMimeObject *);
+      void on_crypto_done ();
+      void emit_crypto_done ();
+
+      type_signal_crypto_done m_signal_crypto_done;
+
+    public:
+
       /* attachment specific stuff */
       ustring get_filename ();
       size_t  get_file_size ();
@@ -1,14 +1,22 @@
 # include <iostream>
 # include <sys/time.h>
 # include <sys/wait.h>
+# include <poll.h>
+# include <fcntl.h>
+# include <signal.h>
+# include <pthread.h>
+# include <sys/stat.h>
 
 # include <boost/filesystem.hpp>
 # include <glib.h>
+# include <glib-unix.h>
 # include <gio/gio.h>
 # include <thread>
 # include <mutex>
 # include <condition_variable>
 # include <chrono>
+# include <algorithm>
+# include <cstring>
 
 # include <gmime/gmime.h>
 # include "utils/gmime/gmime-compat.h"
@@ -45,6 +53,11 @@ namespace Astroid {
 
   ComposeMessage::~ComposeMessage () {
     if (send_thread.joinable ()) send_thread.join ();
+
+    for (int fd : cancel_pipe) {
+      if (fd >= 0) ::close (fd);
+    }
+
     g_object_unref (message);
 
     LOG (debug) << "cm: deinitialized.";
@@ -164,6 +177,7 @@ namespace Astroid {
 
       GMimePart * text = messagePart;
       GMimeMultipart * mp = g_mime_multipart_new_with_subtype ("alternative");
+      if (cache) set_boundary (mp, cache->boundary_alternative);
 
       /* add text part */
       g_mime_multipart_add (mp, GMIME_OBJECT(messagePart));
@@ -179,60 +193,84 @@ namespace Astroid {
 
       GMimeStream * contentStream;
 
-      /* pipe through markdown to html generator */
-      int pid;
-      int stdin;
-      int stdout;
-      int stderr;
-      markdown_success = true;
-      vector<string> args = Glib::shell_parse_argv (astroid->config().get<string>("editor.markdown_processor"));
-      try {
-        Glib::spawn_async_with_pipes ("",
-                          args,
-                          Glib::SPAWN_DO_NOT_REAP_CHILD |
-                          Glib::SPAWN_SEARCH_PATH,
-                          sigc::slot <void> (),
-                          &pid,
-                          &stdin,
-                          &stdout,
-                          &stderr
-                          );
+      std::string processor = astroid->config().get<string>("editor.markdown_processor");
+      std::string md_input  = processor + "\n" + md_body_content;
 
-        refptr<Glib::IOChannel> ch_stdin;
-        refptr<Glib::IOChannel> ch_stdout;
-        refptr<Glib::IOChannel> ch_stderr;
-        ch_stdin  = Glib::IOChannel::create_from_fd (stdin);
-        ch_stdout = Glib::IOChannel::create_from_fd (stdout);
-        ch_stderr = Glib::IOChannel::create_from_fd (stderr);
+      if (cache && cache->markdown_input == md_input) {
+        /* the body has not changed since it was last processed */
+        LOG (debug) << "cm: md: using cached html.";
 
-        ch_stdin->write (md_body_content);
-        ch_stdin->close ();
+        markdown_success = cache->markdown_success;
+        markdown_error   = cache->markdown_error;
 
-        ustring _html;
-        ch_stdout->read_to_end (_html);
-        ch_stdout->close ();
+        if (markdown_success) {
+          contentStream = g_mime_stream_mem_new_with_buffer (cache->markdown_html.c_str(), cache->markdown_html.size());
+        }
 
+      } else {
 
-        ustring _err;
-        ch_stderr->read_to_end (_err);
-        ch_stderr->close ();
+        /* pipe through markdown to html generator */
+        int pid;
+        int stdin;
+        int stdout;
+        int stderr;
+        markdown_success = true;
+        vector<string> args = Glib::shell_parse_argv (processor);
+        try {
+          Glib::spawn_async_with_pipes ("",
+                            args,
+                            Glib::SPAWN_DO_NOT_REAP_CHILD |
+                            Glib::SPAWN_SEARCH_PATH,
+                            sigc::slot <void> (),
+                            &pid,
+                            &stdin,
+                            &stdout,
+                            &stderr
+                            );
+
+          refptr<Glib::IOChannel> ch_stdin;
+          refptr<Glib::IOChannel> ch_stdout;
+          refptr<Glib::IOChannel> ch_stderr;
+          ch_stdin  = Glib::IOChannel::create_from_fd (stdin);
+          ch_stdout = Glib::IOChannel::create_from_fd (stdout);
+          ch_stderr = Glib::IOChannel::create_from_fd (stderr);
+
+          ch_stdin->write (md_body_content);
+          ch_stdin->close ();
+
+          ustring _html;
+          ch_stdout->read_to_end (_html);
+          ch_stdout->close ();
+
+
+          ustring _err;
+          ch_stderr->read_to_end (_err);
+          ch_stderr->close ();
+
+          if (!_err.empty ()) {
+            LOG (error) << "cm: md: " << _err;
+            markdown_error   = _err;
+            markdown_success = false;
+          } else {
 
-        if (!_err.empty ()) {
-          LOG (error) << "cm: md: " << _err;
-          markdown_error   = _err;
-          markdown_success = false;
-        } else {
+            LOG (debug) << "cm: md: got html: " << _html;
 
-          LOG (debug) << "cm: md: got html: " << _html;
+            contentStream = g_mime_stream_mem_new_with_buffer(_html.c_str(), _html.size());
+          }
 
-          contentStream = g_mime_stream_mem_new_with_buffer(_html.c_str(), _html.size());
-        }
+          if (cache) {
+            cache->markdown_input   = md_input;
+            cache->markdown_html    = _html;
+            cache->markdown_success = markdown_success;
+            cache->markdown_error   = markdown_error;
+          }
 
-      } catch (Glib::SpawnError &ex) {
-        LOG (error) << "cm: md: failed to spawn markdown processor: " << ex.what ();
+        } catch (Glib::SpawnError &ex) {
+          LOG (error) << "cm: md: failed to spawn markdown processor: " << ex.what ();
 
-        markdown_success = false;
-        markdown_error   = "Failed to spawn markdown processor: " + ex.what();
+          markdown_success = false;
+          markdown_error   = "Failed to spawn markdown processor: " + ex.what();
+        }
       }
 
       if (markdown_success) {
@@ -326,9 +364,13 @@ namespace Astroid {
     }
 
     /* attachments  */
+    attachments_success = true;
+    attachments_error   = "";
+
     if (attachments.size() > 0)
     {
       GMimeMultipart * multipart = g_mime_multipart_new_with_subtype("mixed");
+      if (cache) set_boundary (multipart, cache->boundary_mixed);
       g_mime_multipart_add (multipart, (GMimeObject*) message->mime_part);
       g_mime_message_set_mime_part (message, (GMimeObject*) multipart);
 
@@ -347,22 +389,65 @@ namespace Astroid {
 
         if (a->is_mime_message) {
 
-          GMimeMessagePart * mp = g_mime_message_part_new_with_message ("rfc822", (GMimeMessage*) a->message->message);
+          GMimeMessage * msg = (GMimeMessage *) a->message->message;
+
+          if (private_parts) {
+            msg = copy_message (msg);
+          } else {
+            g_object_ref (msg);
+          }
+
+          GMimeMessagePart * mp = g_mime_message_part_new_with_message ("rfc822", msg);
           g_mime_multipart_add (multipart, (GMimeObject *) mp);
 
           g_object_unref (mp);
+          g_object_unref (msg);
 
         } else {
 
-          GMimeStream * file_stream;
+          /* the contents of the attachment are not read here, they are
+           * streamed (and encoded) when the message is written. */
+          GMimeDataWrapper * data;
 
+          if (a->data_wrapper) {
+            /* part of an existing message, still in its original encoding */
+            if (private_parts) {
+              data = copy_data_wrapper (a->data_wrapper);
+            } else {
+              data = a->data_wrapper;
+              g_object_ref (data);
+            }
 
-          file_stream = g_mime_stream_mem_new_with_byte_array (a->contents->gobj());
-          g_mime_stream_mem_set_owner (GMIME_STREAM_MEM (file_stream), false);
-
-
-          GMimeDataWrapper * data = g_mime_data_wrapper_new_with_stream (file_stream,
-              GMIME_CONTENT_ENCODING_DEFAULT);
+          } else {
+            GMimeStream * file_stream;
+
+            if (a->contents) {
+              file_stream = g_mime_stream_mem_new_with_byte_array (a->contents->gobj());
+              g_mime_stream_mem_set_owner (GMIME_STREAM_MEM (file_stream), false);
+
+            } else {
+              GError * err = NULL;
+              file_stream = g_mime_stream_fs_open (a->fname.c_str (), O_RDONLY, 0644, &err);
+
+              if (file_stream == NULL) {
+                ustring e = ustring::compose ("could not open attachment: %1: %2",
+                    a->fname.c_str (), (err ? err->message : "unknown error"));
+                LOG (error) << "cm: " << e;
+                if (err) g_error_free (err);
+
+                /* the message is still built so that it can be previewed,
+                 * but it must not be sent or saved without the attachment */
+                attachments_success = false;
+                if (!attachments_error.empty ()) attachments_error += "\n";
+                attachments_error  += e;
+                continue;
+              }
+            }
+
+            data = g_mime_data_wrapper_new_with_stream (file_stream,
+                GMIME_CONTENT_ENCODING_DEFAULT);
+            g_object_unref (file_stream);
+          }
 
           GMimeContentType * contentType = g_mime_content_type_parse (g_mime_parser_options_get_default (), a->content_type.c_str ());
 
@@ -383,7 +468,6 @@ namespace Astroid {
 
           g_object_unref (part);
           g_object_unref (contentType);
-          g_object_unref (file_stream);
           g_object_unref (data);
         }
 
@@ -397,12 +481,50 @@ namespace Astroid {
     encryption_error = "";
     GError * err = NULL;
 
-    if (encrypt || sign) {
+    if ((encrypt || sign) && defer_crypto) {
+      LOG (debug) << "cm: encryption and signing deferred.";
+
+    } else if (encrypt || sign) {
       GMimeObject * content = g_mime_message_get_mime_part (message);
 
+      ustring input;
+      GMimeObject * cached = NULL;
+
+      if (cache) {
+        input = crypto_input ();
+
+        if (cache->crypto_input == input) {
+          /* the same content has already been encrypted or signed for
+           * the same recipients and keys, the part is parsed from the
+           * file it was stored in and stays on disk. */
+          GError * ferr = NULL;
+          GMimeStream * stream = g_mime_stream_fs_open (
+              cache->crypto_output.c_str (), O_RDONLY, 0, &ferr);
+
+          if (stream == NULL) {
+            LOG (warn) << "cm: could not open cached encrypted part: " << (ferr ? ferr->message : "unknown error");
+            if (ferr) g_error_free (ferr);
+
+          } else {
+            GMimeParser * parser = g_mime_parser_new_with_stream (stream);
+            cached = g_mime_parser_construct_part (parser, NULL);
+
+            g_object_unref (parser);
+            g_object_unref (stream);
+          }
+        }
+      }
+
       Crypto cy ("application/pgp-encrypted");
 
-      if (encrypt) {
+      if (cached) {
+        LOG (debug) << "cm: using cached encrypted or signed part.";
+
+        g_mime_message_set_mime_part (message, cached);
+        g_object_unref (cached);
+        encryption_success = true;
+
+      } else if (encrypt) {
 
         GMimeMultipartEncrypted * e_content = NULL;
         encryption_success = cy.encrypt (content, sign, account->gpgkey, from, AddressList (to) + AddressList (cc) + AddressList (bcc), &e_content, &err);
@@ -425,10 +547,105 @@ namespace Astroid {
       if (!encryption_success) {
         encryption_error = err->message;
         LOG (error) << "cm: failed encrypting or signing: " << encryption_error;
+
+      } else if (cache && !cached) {
+        /* keep the part in a file which is only readable by the user */
+        char * fname = NULL;
+        int fd = g_file_open_tmp ("astroid-crypto-XXXXXX", &fname, NULL);
+
+        if (fd < 0) {
+          LOG (warn) << "cm: could not store encrypted part.";
+
+        } else {
+          GMimeStream * stream = g_mime_stream_fs_new (fd);
+          g_mime_object_write_to_stream (g_mime_message_get_mime_part (message), g_mime_format_options_get_default (), stream);
+          g_mime_stream_flush (stream);
+          g_object_unref (stream);
+
+          if (!cache->crypto_output.empty ()) unlink (cache->crypto_output.c_str ());
+
+          cache->crypto_input  = input;
+          cache->crypto_output = fname;
+          g_free (fname);
+        }
       }
     }
   }
 
+  ComposeMessage::BuildCache::~BuildCache () {
+    if (!crypto_output.empty ()) unlink (crypto_output.c_str ());
+  }
+
+  ustring ComposeMessage::crypto_input () {
+    /* the encrypted or signed part can be reused as long as the content,
+     * the recipients, the keys and the keyring stay the same. the content
+     * is identified by its sources rather than by serializing it. */
+    Glib::Checksum chk (Glib::Checksum::ChecksumType::CHECKSUM_SHA256);
+
+    chk.update (body.str () + "\n");
+
+    if (include_signature && account) {
+      chk.update (ustring::compose ("%1:%2:", account->signature_attach, account->signature_separate));
+      chk.update (file_state (account->signature_file));
+    }
+
+    chk.update (ustring::compose ("%1:%2:%3:%4:%5\n",
+          markdown, markdown_success, attachments_success,
+          astroid->config ().get<string> ("editor.charset"),
+          astroid->config ().get<bool> ("mail.format_flowed")));
+
+    if (markdown && markdown_success) {
+      chk.update (cache->markdown_html + "\n");
+    }
+
+    chk.update (cache->boundary_alternative + ":" + cache->boundary_mixed + "\n");
+
+    for (auto &a : attachments) {
+      chk.update (ustring::compose ("%1:%2:%3:%4:%5:%6\n",
+            a->name, a->content_type, a->dispostion_inline, a->chunk_id,
+            a->data_wrapper, a->message ? a->message->mid : ustring ()));
+
+      if (!a->fname.empty ()) {
+        chk.update (file_state (a->fname));
+      } else if (a->contents) {
+        chk.update (a->contents->get_data (), a->contents->size ());
+      }
+    }
+
+    chk.update (ustring::compose ("%1:%2:%3:%4\n", encrypt, sign, account->gpgkey, account->email));
+
+    if (encrypt) {
+      chk.update ((AddressList (to) + AddressList (cc) + AddressList (bcc)).str ());
+    }
+
+    chk.update (SignatureCache::keyring_state ());
+
+    return chk.get_string ();
+  }
+
+  ustring ComposeMessage::file_state (bfs::path p) {
+    /* a file is assumed to be unchanged as long as its size and
+     * modification time are */
+    struct stat st;
+    if (stat (p.c_str (), &st) != 0) {
+      return ustring::compose ("%1:missing\n", p.c_str ());
+    }
+
+    return ustring::compose ("%1:%2:%3.%4\n", p.c_str (),
+        (long long) st.st_size, (long long) st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+  }
+
+  void ComposeMessage::set_boundary (GMimeMultipart * mp, std::string & boundary) {
+    /* the same boundary is used every time the message is built, otherwise
+     * the content to be encrypted would never be the same */
+    if (boundary.empty ()) {
+      g_mime_multipart_set_boundary (mp, NULL); // generates a new one
+      boundary = g_mime_multipart_get_boundary (mp);
+    } else {
+      g_mime_multipart_set_boundary (mp, boundary.c_str ());
+    }
+  }
+
   void ComposeMessage::add_attachment (shared_ptr<Attachment> a) {
     attachments.push_back (a);
   }
@@ -438,22 +655,17 @@ namespace Astroid {
     std::lock_guard<std::mutex> lk (send_cancel_m);
 
     cancel_send_during_delay = true;
+    send_cancelled = true;
 
-    if (pid > 0) {
-
-      int r = kill (pid, SIGKILL);
-
-      if (r == 0) {
-        LOG (warn) << "cm: sendmail killed.";
-      } else {
-        LOG (error) << "cm: could not kill sendmail.";
+    /* wake up the send thread, which kills sendmail if it is running */
+    if (cancel_pipe[1] >= 0) {
+      char c = 0;
+      if (::write (cancel_pipe[1], &c, 1) < 0) {
+        LOG (error) << "cm: could not signal sending to cancel.";
       }
     }
 
     send_cancel_cv.notify_one ();
-    if (send_thread.joinable ()) {
-      send_thread.detach ();
-    }
 
     return true;
   }
@@ -462,17 +674,49 @@ namespace Astroid {
   {
     LOG (info) << "cm: sending (threaded)..";
     cancel_send_during_delay = false;
+    send_cancelled = false;
+
+    if (cancel_pipe[0] < 0 && !g_unix_open_pipe (cancel_pipe, FD_CLOEXEC, NULL)) {
+      LOG (error) << "cm: could not create cancel pipe.";
+    }
+
+    {
+      std::lock_guard<std::mutex> lk (send_cancel_m);
+      in_send_delay = true;
+    }
+
     send_thread = std::thread (&ComposeMessage::send, this);
   }
 
+  bool ComposeMessage::cancel_delayed () {
+    /* only cancels the message if it has not yet been given to sendmail */
+    std::lock_guard<std::mutex> lk (send_cancel_m);
+
+    if (!in_send_delay) return false;
+
+    LOG (info) << "cm: cancelling message waiting to be sent.";
+    cancel_send_during_delay = true;
+    send_cancel_cv.notify_one ();
+
+    return true;
+  }
+
+  void ComposeMessage::wait_sent () {
+    if (send_thread.joinable ()) send_thread.join ();
+  }
+
   bool ComposeMessage::send () {
 
     dryrun = astroid->config().get<bool>("astroid.debug.dryrun_sending");
+    send_timeout = astroid->config ().get<int> ("mail.send_timeout");
 
     message_send_status_warn = false;
     message_send_status_msg  = "";
 
-    unsigned int delay = astroid->config ().get<unsigned int> ("mail.send_delay");
+    unsigned int delay = 0;
+    if (use_send_delay) {
+      delay = astroid->config ().get<unsigned int> ("mail.send_delay");
+    }
     std::unique_lock<std::mutex> lk (send_cancel_m);
 
     while (delay > 0 && !cancel_send_during_delay) {
@@ -489,6 +733,8 @@ namespace Astroid {
       delay--;
     }
 
+    in_send_delay = false;
+
     if (cancel_send_during_delay) {
       LOG (error) << "cm: cancelled sending before message could be sent.";
       message_send_status_msg = "sending message... cancelled before sending.";
@@ -523,6 +769,26 @@ namespace Astroid {
 
       LOG (debug) << "cm: sending message using command: " << send_command;
 
+      /* the message is streamed from the copy already written to disk,
+       * it is never serialized on this thread since its parts may be
+       * shared with messages on the GUI thread. */
+      GError * err = NULL;
+      GMimeStream * src = g_mime_stream_fs_open (send_file.c_str (), O_RDONLY, 0644, &err);
+
+      if (src == NULL) {
+        LOG (error) << "cm: could not open: " << send_file << ": " << (err ? err->message : "unknown error");
+        if (err) g_error_free (err);
+
+        message_send_status_msg = "message could not be sent: could not read queued message!";
+        message_send_status_warn = true;
+        d_message_send_status ();
+
+        message_sent_result = false;
+        d_message_sent ();
+        pid = 0;
+        return false;
+      }
+
       vector<string> args = Glib::shell_parse_argv (send_command);
       try {
         Glib::spawn_async_with_pipes ("",
@@ -537,6 +803,7 @@ namespace Astroid {
                           );
       } catch (Glib::SpawnError &ex) {
         LOG (error) << "cm: could not send message!";
+        g_object_unref (src);
 
         message_send_status_msg = "message could not be sent!";
         message_send_status_warn = true;
@@ -548,58 +815,19 @@ namespace Astroid {
         return false;
       }
 
-      /* connect channels */
-      refptr<Glib::IOChannel> ch_stdout;
-      refptr<Glib::IOChannel> ch_stderr;
-      ch_stdout = Glib::IOChannel::create_from_fd (stdout);
-      ch_stderr = Glib::IOChannel::create_from_fd (stderr);
+      /* write the message while draining stdout and stderr, until sendmail
+       * is done, the send is cancelled or it times out. */
+      bool piped = pipe_sendmail (stdin, stdout, stderr, src);
 
-      /* write message to sendmail */
-      GMimeStream * stream = g_mime_stream_pipe_new (stdin);
-      g_mime_stream_pipe_set_owner (GMIME_STREAM_PIPE(stream), true); // causes stdin to be closed when stream is closed
-      g_mime_object_write_to_stream (GMIME_OBJECT(message), g_mime_format_options_get_default (), stream);
-      g_mime_stream_flush (stream);
-      g_object_unref (stream); // closes stdin
+      g_object_unref (src);
 
       /* wait for sendmail to finish */
-      int status;
-      pid_t wp = waitpid (pid, &status, 0);
-
-      if (wp == (pid_t)-1) {
-        LOG (error) << "cm: error when executing sendmail process: " << errno << ", unknown if message was sent.";
-      }
+      int status = -1;
+      pid_t wp = wait_sendmail (piped, &status);
 
       g_spawn_close_pid (pid);
 
-      /* these read_to_end's are necessary to wait for the pipes to be closed, hopefully
-       * ensuring that any child processed forked by the sendmail process
-       * has also finished */
-      if (ch_stdout) {
-        Glib::ustring buf;
-
-        ch_stdout->read_to_end(buf);
-        if (*(--buf.end()) == '\n') buf.erase (--buf.end());
-
-        if (!buf.empty ()) LOG (debug) << "sendmail: " << buf;
-        ch_stdout->close ();
-        ch_stdout.clear ();
-      }
-
-      if (ch_stderr) {
-        Glib::ustring buf;
-
-        ch_stderr->read_to_end(buf);
-        if (*(--buf.end()) == '\n') buf.erase (--buf.end());
-
-        if (!buf.empty ()) LOG (warn) << "sendmail: " << buf;
-        ch_stderr->close ();
-        ch_stderr.clear ();
-      }
-
-      ::close (stdout);
-      ::close (stderr);
-
-      if (status == 0 && wp != (pid_t)-1)
+      if (piped && status == 0 && wp != (pid_t)-1)
       {
         LOG (warn) << "cm: message sent successfully!";
 
@@ -608,7 +836,7 @@ namespace Astroid {
           save_to = account->save_sent_to / path(id + ":2,");
           LOG (info) << "cm: saving message to: " << save_to;
 
-          write (save_to.c_str());
+          copy_send_file (save_to.c_str ());
         }
 
         message_send_status_msg = "message sent successfully!";
@@ -623,7 +851,13 @@ namespace Astroid {
       } else {
         LOG (error) << "cm: could not send message: " << status << "!";
 
-        message_send_status_msg = "message could not be sent!";
+        if (send_cancelled) {
+          message_send_status_msg = "sending message... cancelled.";
+        } else if (send_timed_out) {
+          message_send_status_msg = "message could not be sent: sendmail timed out!";
+        } else {
+          message_send_status_msg = "message could not be sent!";
+        }
         message_send_status_warn = true;
         d_message_send_status ();
 
@@ -639,7 +873,7 @@ namespace Astroid {
       message_send_status_warn = true;
       d_message_send_status ();
 
-      write (fname);
+      copy_send_file (fname);
       message_sent_result = false;
       d_message_sent ();
       pid = 0;
@@ -647,6 +881,226 @@ namespace Astroid {
     }
   }
 
+  GMimeDataWrapper * ComposeMessage::copy_data_wrapper (GMimeDataWrapper * d) {
+    /* the stream of the wrapper is a part of the stream of the message it
+     * was taken from, which is read by the GUI thread. */
+    GMimeStream * src = g_mime_data_wrapper_get_stream (d);
+    GMimeStream * mem = g_mime_stream_mem_new ();
+
+    g_mime_stream_reset (src);
+    g_mime_stream_write_to_stream (src, mem);
+    g_mime_stream_reset (src);
+    g_mime_stream_reset (mem);
+
+    GMimeDataWrapper * copy = g_mime_data_wrapper_new_with_stream (mem,
+        g_mime_data_wrapper_get_encoding (d));
+    g_object_unref (mem);
+
+    return copy;
+  }
+
+  GMimeMessage * ComposeMessage::copy_message (GMimeMessage * m) {
+    GMimeStream * mem = g_mime_stream_mem_new ();
+    g_mime_object_write_to_stream (GMIME_OBJECT(m), g_mime_format_options_get_default (), mem);
+    g_mime_stream_reset (mem);
+
+    GMimeParser  * parser = g_mime_parser_new_with_stream (mem);
+    GMimeMessage * copy   = g_mime_parser_construct_message (parser, g_mime_parser_options_get_default ());
+
+    g_object_unref (parser);
+    g_object_unref (mem);
+
+    if (copy == NULL) {
+      LOG (error) << "cm: could not copy attached message.";
+      g_object_ref (m);
+      return m;
+    }
+
+    return copy;
+  }
+
+  void ComposeMessage::copy_send_file (ustring fname) {
+    try {
+      bfs::copy_file (send_file.c_str (), fname.c_str (), bfs::copy_option::overwrite_if_exists);
+    } catch (bfs::filesystem_error &ex) {
+      LOG (error) << "cm: could not write: " << fname << ": " << ex.what ();
+    }
+  }
+
+  bool ComposeMessage::pipe_sendmail (int in, int out, int err, GMimeStream * src) {
+    /* runs on the send thread. a write to a closed pipe should fail with
+     * EPIPE rather than raise SIGPIPE. */
+    sigset_t sigpipe;
+    sigemptyset (&sigpipe);
+    sigaddset (&sigpipe, SIGPIPE);
+    pthread_sigmask (SIG_BLOCK, &sigpipe, NULL);
+
+    for (int fd : { in, out, err }) {
+      fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    /* the message is read from src a chunk at the time */
+    std::vector<char> buf (SEND_CHUNK_SZ);
+    gsize buf_pos = 0, buf_len = 0;
+
+    gint64 len = g_mime_stream_length (src);
+    gsize written = 0;
+    std::string outbuf, errbuf;
+
+    auto now = std::chrono::steady_clock::now ();
+    auto last_progress = now;
+    deadline = now + std::chrono::seconds (send_timeout);
+
+    bool ok = true;
+    send_timed_out = false;
+
+    while (in >= 0 || out >= 0 || err >= 0) {
+      /* negative fds are ignored by poll */
+      struct pollfd fds[4] = {
+        { cancel_pipe[0], POLLIN, 0 },
+        { in,  POLLOUT, 0 },
+        { out, POLLIN, 0 },
+        { err, POLLIN, 0 },
+      };
+
+      int timeout = -1;
+      if (send_timeout > 0) {
+        timeout = std::max (0, (int) std::chrono::duration_cast<std::chrono::milliseconds> (
+              deadline - std::chrono::steady_clock::now ()).count ());
+      }
+
+      int r = poll (fds, 4, timeout);
+
+      if (r < 0) {
+        if (errno == EINTR) continue;
+
+        LOG (error) << "cm: error waiting for sendmail: " << errno;
+        ok = false;
+        break;
+      }
+
+      if (r == 0) {
+        LOG (error) << "cm: sendmail timed out after " << send_timeout << " seconds.";
+        send_timed_out = true;
+        ok = false;
+        break;
+      }
+
+      if (fds[0].revents) {
+        LOG (warn) << "cm: sending cancelled.";
+        ok = false;
+        break;
+      }
+
+      if (fds[1].revents) {
+        if (buf_pos == buf_len) {
+          ssize_t r = g_mime_stream_read (src, buf.data (), buf.size ());
+
+          if (r < 0) {
+            LOG (error) << "cm: could not read message to send.";
+            ok = false;
+          }
+
+          if (r <= 0) {
+            ::close (in); // signals end of message
+            in = -1;
+            continue;
+          }
+
+          buf_pos = 0;
+          buf_len = r;
+        }
+
+        ssize_t n = ::write (in, buf.data () + buf_pos, buf_len - buf_pos);
+
+        if (n > 0) {
+          buf_pos += n;
+          written += n;
+
+          now = std::chrono::steady_clock::now ();
+          if (now - last_progress >= std::chrono::milliseconds (500)) {
+            last_progress = now;
+            if (len > 0) {
+              message_send_status_msg = ustring::compose ("sending message... (%1 of %2 kB)",
+                  written / 1024, len / 1024);
+            } else {
+              message_send_status_msg = ustring::compose ("sending message... (%1 kB)",
+                  written / 1024);
+            }
+            d_message_send_status ();
+          }
+
+        } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+          LOG (error) << "cm: sendmail closed its input before the message was written (" << errno << ").";
+          ok = false;
+
+          ::close (in);
+          in = -1;
+        }
+      }
+
+      for (auto p : { std::make_pair (&fds[2], &outbuf), std::make_pair (&fds[3], &errbuf) }) {
+        if (p.first->revents) {
+          char buf[4096];
+          ssize_t n = ::read (p.first->fd, buf, sizeof (buf));
+
+          if (n > 0) {
+            p.second->append (buf, n);
+          } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            ::close (p.first->fd);
+            if (p.first->fd == out) out = -1;
+            else                    err = -1;
+          }
+        }
+      }
+    }
+
+    for (int fd : { in, out, err }) {
+      if (fd >= 0) ::close (fd);
+    }
+
+    if (!outbuf.empty ()) LOG (debug) << "sendmail: " << UstringUtils::replace (outbuf, "\n", " ");
+    if (!errbuf.empty ()) LOG (warn)  << "sendmail: " << UstringUtils::replace (errbuf, "\n", " ");
+
+    return ok;
+  }
+
+  pid_t ComposeMessage::wait_sendmail (bool piped, int * status) {
+    /* sendmail has closed its output, but may not have exited yet. */
+    if (piped) {
+      while (true) {
+        pid_t wp = waitpid (pid, status, WNOHANG);
+
+        if (wp != 0) {
+          if (wp == (pid_t)-1) {
+            LOG (error) << "cm: error when executing sendmail process: " << errno << ", unknown if message was sent.";
+          }
+
+          return wp;
+        }
+
+        if (send_cancelled || (send_timeout > 0 && std::chrono::steady_clock::now () >= deadline)) {
+          if (!send_cancelled) {
+            LOG (error) << "cm: sendmail timed out after " << send_timeout << " seconds.";
+            send_timed_out = true;
+          }
+
+          break;
+        }
+
+        std::this_thread::sleep_for (std::chrono::milliseconds (50));
+      }
+    }
+
+    /* cancelled, timed out or failed */
+    if (kill (pid, SIGKILL) == 0) {
+      LOG (warn) << "cm: sendmail killed.";
+    }
+
+    waitpid (pid, status, 0);
+    return (pid_t)-1;
+  }
+
   /* signals */
   ComposeMessage::type_message_sent
     ComposeMessage::message_sent ()
@@ -658,13 +1112,17 @@ namespace Astroid {
     m_message_sent.emit (res);
   }
 
-  void ComposeMessage::message_sent_event () {
-    /* add to notmuch with sent tag (on main GUI thread) */
+  void ComposeMessage::add_sent_message () {
     if (!dryrun && message_sent_result && account->save_sent) {
       astroid->actions->doit (refptr<Action> (
             new AddSentMessage (save_to.c_str (), account->additional_sent_tags, inreplyto)));
       LOG (info) << "cm: sent message added to db.";
     }
+  }
+
+  void ComposeMessage::message_sent_event () {
+    /* add to notmuch with sent tag (on main GUI thread) */
+    add_sent_message ();
 
     emit_message_sent (message_sent_result);
   }
@@ -695,6 +1153,13 @@ namespace Astroid {
     }
 
     int fd = mkstemp(temporaryFilePath);
+
+    if (fd < 0) {
+      LOG (error) << "cm: could not create tmp file: " << temporaryFilePath;
+      free(temporaryFilePath);
+      return "";
+    }
+
     message_file = temporaryFilePath;
     free(temporaryFilePath);
 
@@ -723,6 +1188,37 @@ namespace Astroid {
     LOG (debug) << "cm: wrote file: " << fname;
   }
 
+  bool ComposeMessage::load_queued (ustring fname) {
+    GError * err = NULL;
+    GMimeStream * stream = g_mime_stream_file_open (fname.c_str(), "r", &err);
+
+    if (stream == NULL) {
+      LOG (error) << "cm: could not open queued message: " << fname << ": " << err->message;
+      g_error_free (err);
+      return false;
+    }
+
+    GMimeParser * parser = g_mime_parser_new_with_stream (stream);
+    GMimeMessage * _message = g_mime_parser_construct_message (parser, g_mime_parser_options_get_default ());
+
+    g_object_unref (parser);
+    g_object_unref (stream);
+
+    if (_message == NULL) {
+      LOG (error) << "cm: could not parse queued message: " << fname;
+      return false;
+    }
+
+    g_object_unref (message);
+    message = _message;
+
+    return true;
+  }
+
+  bool ComposeMessage::cancelled () {
+    return send_cancelled;
+  }
+
   void ComposeMessage::write (GMimeStream * stream) {
     g_object_ref (stream);
 
@@ -779,27 +1275,9 @@ namespace Astroid {
       is_mime_message = true;
 
       name = message->subject;
-
-    } else {
-      /* load into byte array */
-      refptr<Gio::File> fle = Glib::wrap (file, false);
-      refptr<Gio::FileInputStream> istr = fle->read ();
-
-      refptr<Glib::Bytes> b;
-      contents = Glib::ByteArray::create ();
-
-      do {
-        b = istr->read_bytes (4096, refptr<Gio::Cancellable>(NULL));
-
-        if (b) {
-          gsize s = b->get_size ();
-          if (s <= 0) break;
-          contents->append ((const guint8 *) b->get_data (s), s);
-        }
-
-      } while (b);
     }
 
+    /* the contents of the file are read when the message is written */
     g_object_unref (file);
     g_object_unref (file_info);
   }
@@ -824,7 +1302,17 @@ namespace Astroid {
 
     } else {
 
-      contents = c->contents ();
+      if (c->mime_object != NULL && GMIME_IS_PART (c->mime_object)) {
+        /* keep the (still encoded) content of the part, it is only
+         * decoded when the message is written */
+        data_wrapper = g_mime_part_get_content (GMIME_PART (c->mime_object));
+      }
+
+      if (data_wrapper != NULL) {
+        g_object_ref (data_wrapper);
+      } else {
+        contents = c->contents ();
+      }
 
       const char * ct = g_mime_content_type_get_mime_type (c->content_type);
       if (ct != NULL) {
@@ -848,6 +1336,8 @@ namespace Astroid {
 
   ComposeMessage::Attachment::~Attachment () {
     LOG (debug) << "cm: at: deconstruct";
+
+    if (data_wrapper) g_object_unref (data_wrapper);
   }
 
 }
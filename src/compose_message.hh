@@ -9,6 +9,8 @@
 # include <thread>
 # include <mutex>
 # include <condition_variable>
+# include <atomic>
+# include <chrono>
 
 # include <gmime/gmime.h>
 
@@ -49,6 +51,10 @@ namespace Astroid {
       bool markdown_success = false;
       ustring markdown_error = "";
 
+      /* an attachment could not be read, the message is incomplete */
+      bool attachments_success = true;
+      ustring attachments_error = "";
+
       struct Attachment {
         public:
           Attachment ();
@@ -62,7 +68,11 @@ namespace Astroid {
           bool    dispostion_inline = false;
           bool    valid;
 
+          /* attachments are read from their file or from the part of the
+           * message they came from when the message is written, only
+           * attachments without either are kept in contents. */
           refptr<Glib::ByteArray> contents;
+          GMimeDataWrapper *      data_wrapper = NULL;
           std::string             content_type;
           refptr<Message>         message;
 
@@ -80,22 +90,98 @@ namespace Astroid {
       void send_threaded ();
       bool cancel_sending ();
       ustring write_tmp (); // write message to tmpfile
+      bool load_queued (ustring); // load a finalized message to be sent again
       void write (ustring); // write message to some file
       void write (GMimeStream *); // write to stream
 
+      /* the already written copy of the message (in the outbox) that is
+       * streamed to sendmail, the message itself is not written by the
+       * send thread. */
+      ustring send_file;
+
+      /* copy the parts taken from other messages when building, so that
+       * the message can be written on another thread (e.g. drafts) */
+      bool private_parts = false;
+
+      /* wait mail.send_delay before sending */
+      bool use_send_delay = true;
+
+      /* sending was cancelled by the user */
+      bool cancelled ();
+
+      /* cancel sending if the message is still waiting for mail.send_delay,
+       * returns false if it has already been given to sendmail. */
+      bool cancel_delayed ();
+
+      /* wait for the send thread to finish, the result is in
+       * message_sent_result. */
+      void wait_sent ();
+
+      /* add the sent message to notmuch with the sent tags */
+      void add_sent_message ();
+
+      /* size and modification time of a file, identifies its content */
+      static ustring file_state (bfs::path);
+
       /* encryption */
       bool encryption_success = false;
       ustring encryption_error = "";
 
+      /* leave out encryption and signing, e.g. for a preview. the message
+       * is encrypted or signed when it is finalized to be sent. */
+      bool defer_crypto = false;
+
+      /* the results of the expensive stages of building the message,
+       * markdown processing and encryption, kept between builds of the
+       * same message (e.g. by the editor). a stage is only run again when
+       * its input has changed. */
+      struct BuildCache {
+        std::string markdown_input;
+        std::string markdown_html;
+        bool        markdown_success = false;
+        ustring     markdown_error;
+
+        ustring     crypto_input;  // digest of content, recipients and keys
+        bfs::path   crypto_output; // file with the signed or encrypted part
+
+        ~BuildCache ();
+
+        std::string boundary_alternative;
+        std::string boundary_mixed;
+      };
+
+      BuildCache * cache = NULL;
+
     private:
+      ustring crypto_input ();
+      void    set_boundary (GMimeMultipart *, std::string & boundary);
+
       ustring message_file;
       bfs::path save_to;
       bool      dryrun;
 
       /* sendmail process */
       bool cancel_send_during_delay = false;
+      bool in_send_delay = false; // protected by send_cancel_m
       int pid;
 
+      /* written to by cancel_sending () to wake up the send thread */
+      int cancel_pipe[2] = { -1, -1 };
+      std::atomic<bool> send_cancelled { false };
+
+      int  send_timeout = 0; // seconds, 0 to wait forever
+      bool send_timed_out = false;
+      std::chrono::time_point<std::chrono::steady_clock> deadline;
+
+      static const gsize SEND_CHUNK_SZ = 64 * 1024;
+
+      bool  pipe_sendmail (int in, int out, int err, GMimeStream * src);
+      void  copy_send_file (ustring fname);
+
+      static GMimeDataWrapper * copy_data_wrapper (GMimeDataWrapper *);
+      static GMimeMessage * copy_message (GMimeMessage *);
+      pid_t wait_sendmail (bool piped, int * status);
+
       std::thread send_thread;
       std::mutex  send_cancel_m;
       std::condition_variable  send_cancel_cv;
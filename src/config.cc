@@ -223,6 +223,8 @@ namespace Astroid {
 
     default_config.put ("editor.charset", "utf-8");
     default_config.put ("editor.save_draft_on_force_quit", true);
+    default_config.put ("editor.autosave_draft", false);
+    default_config.put ("editor.autosave_draft_delay", 2000); // ms
 
     default_config.put ("editor.attachment_words", "attach");
     default_config.put ("editor.attachment_directory", "~");
@@ -240,6 +242,13 @@ namespace Astroid {
     default_config.put ("mail.message_id_user", ""); // custom user for the message id: default: 'astroid'
     default_config.put ("mail.user_agent", "default");
     default_config.put ("mail.send_delay", 2); // wait seconds before sending, allowing to cancel
+    default_config.put ("mail.send_timeout", 120); // seconds before sendmail is killed, 0 to wait forever
+
+    /* outbox: messages that could not be sent are retried */
+    default_config.put ("mail.outbox.concurrency", 1); // messages sent at the time for each account
+    default_config.put ("mail.outbox.max_attempts", 10); // 0 to retry forever
+    default_config.put ("mail.outbox.retry_delay", 60); // seconds, doubled for each attempt
+    default_config.put ("mail.outbox.max_retry_delay", 3600); // seconds
     default_config.put ("mail.close_on_success", false); // close page automatically on succesful sending of message
     default_config.put ("mail.format_flowed", false); // mail sent with astroid can be reformatted using format_flowed
 
@@ -247,6 +256,22 @@ namespace Astroid {
     default_config.put ("poll.interval", Poll::DEFAULT_POLL_INTERVAL); // seconds
     default_config.put ("poll.always_full_refresh", false); // always do full refresh after poll, slow.
 
+    /* refresh threads when the database is changed by other clients */
+    default_config.put ("poll.watch.database", true);
+    /* poll when new mail arrives in the new/ directories of the maildirs */
+    default_config.put ("poll.watch.maildirs", false);
+    default_config.put ("poll.watch.debounce", 500); // ms
+
+    /* index new mail in the maildirs as it arrives, instead of running
+     * `notmuch new` from poll.sh */
+    default_config.put ("poll.indexer.enable", false);
+    default_config.put ("poll.indexer.batch", 100); // files per transaction
+    default_config.put ("poll.indexer.transaction_time", 100); // ms, per transaction
+    default_config.put ("poll.indexer.debounce", 200); // ms
+
+    /* append a json line with the metrics of each poll to this file */
+    default_config.put ("poll.metrics_file", "");
+
     /* attachments
      *
      *   a chunk is saved and opened with this command */
@@ -280,11 +305,38 @@ namespace Astroid {
     /* expand flagged messages by default */
     default_config.put ("thread_view.expand_flagged", true);
 
+    /* only render the header of collapsed messages until they are expanded */
+    default_config.put ("thread_view.lazy_render", true);
+
+    /* run all thread views in one web process */
+    default_config.put ("thread_view.shared_process", false);
+
+    /* number of thread views to initialize in advance when idle */
+    default_config.put ("thread_view.preload_pool", 1);
+
     /* crypto */
     default_config.put ("crypto.gpg.path", "gpg2");
     default_config.put ("crypto.gpg.always_trust", true);
     default_config.put ("crypto.gpg.enabled", true);
 
+    /* store signature verification results in the cache directory, results
+     * that have not been used for max_age days are removed on startup */
+    default_config.put ("crypto.gpg.cache_signatures", true);
+    default_config.put ("crypto.gpg.cache_signatures_max_age", 30);
+
+    /* number of threads for decryption and verification in the thread view,
+     * 0 means that crypto operations are done while loading the thread. */
+    default_config.put ("crypto.gpg.workers", 2);
+
+    /* keep decrypted parts in memory for ttl seconds */
+    default_config.put ("crypto.cache.enabled", false);
+    default_config.put ("crypto.cache.ttl", 600);
+
+    /* cache recipient key lookups for ttl seconds (0 to not cache), and
+     * look up at most parallel keys at the time */
+    default_config.put ("crypto.keys.ttl", 3600);
+    default_config.put ("crypto.keys.parallel", 4);
+
     /* saved searches */
     default_config.put ("saved_searches.show_on_startup", false);
     default_config.put ("saved_searches.save_history", true);
@@ -305,6 +357,7 @@ namespace Astroid {
       LOG (info) << "cf: test config, loading defaults.";
       config = setup_default_config (true);
       config.put ("poll.interval", 0);
+      config.put ("poll.watch.database", false);
       config.put ("accounts.charlie.gpgkey", "gaute@astroidmail.bar");
       config.put ("mail.send_delay", 0);
       std::string test_nmcfg_path;
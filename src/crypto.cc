@@ -3,6 +3,8 @@
 # include "utils/gmime/gmime-compat.h"
 
 # include <string>
+# include <cstring>
+# include <algorithm>
 
 # include <boost/algorithm/string.hpp>
 
@@ -10,10 +12,14 @@
 # include "config.hh"
 # include "crypto.hh"
 # include "utils/address.hh"
+# include "utils/ustring_utils.hh"
 # include "chunk.hh"
 
 namespace Astroid {
-  Crypto::Crypto (ustring _protocol) {
+  std::mutex Crypto::contexts_m;
+  std::map<ustring, Crypto::Context *> Crypto::contexts;
+
+  Crypto::Crypto (ustring _protocol) : cancelled (false) {
 
     id = Chunk::nextid++;
 
@@ -54,10 +60,22 @@ namespace Astroid {
     /* if (slist)        g_object_unref (slist); */
     /* if (rlist)        g_object_unref (rlist); */
     if (decrypt_res)  g_object_unref (decrypt_res);
-    if (gpgctx)       g_object_unref (gpgctx);
+    if (async_object) g_object_unref (async_object);
+    if (decrypted_object) g_object_unref (decrypted_object);
+  }
+
+  void Crypto::release_contexts () {
+    std::lock_guard<std::mutex> lk (contexts_m);
+
+    for (auto &c : contexts) {
+      if (c.second->gpgctx) g_object_unref (c.second->gpgctx);
+      delete c.second;
+    }
+
+    contexts.clear ();
   }
 
-  GMimeObject * Crypto::decrypt_and_verify (GMimeObject * part) {
+  GMimeObject * Crypto::decrypt_and_verify (GMimeObject * part, ustring cache_key) {
     using std::endl;
     LOG (debug) << "crypto: decrypting and verifiying..";
     decrypt_tried = true;
@@ -70,8 +88,27 @@ namespace Astroid {
     GError *err = NULL;
 
     GMimeMultipartEncrypted * ep = GMIME_MULTIPART_ENCRYPTED (part);
-    GMimeObject * dp = g_mime_multipart_encrypted_decrypt
-	(ep, GMIME_DECRYPT_NONE, NULL, &decrypt_res, &err);
+    GMimeObject * dp = NULL;
+
+    DecryptedCache * cache = astroid->decrypted_cache;
+    bool use_cache = (cache && cache->enabled && !cache_key.empty ());
+    bool cached    = false;
+
+    if (use_cache) {
+      dp = cache->get (cache_key, &decrypt_res);
+      cached = (dp != NULL);
+
+      if (cached) LOG (debug) << "crypto: using cached decrypted part: " << cache_key;
+    }
+
+    if (!cached) {
+# if (GMIME_MAJOR_VERSION < 3)
+      /* gmime 2 runs this operation on the shared context */
+      auto lk = lock_context ();
+# endif
+      dp = g_mime_multipart_encrypted_decrypt
+        (ep, GMIME_DECRYPT_NONE, NULL, &decrypt_res, &err);
+    }
 
     /* GMimeDecryptResult and GMimeCertificates
      *
@@ -129,6 +166,10 @@ namespace Astroid {
 
       verify_tried = (slist != NULL);
       verified = verify_signature_list (slist);
+
+      if (use_cache && !cached) {
+        cache->insert (cache_key, dp, decrypt_res);
+      }
     }
 
     return dp;
@@ -143,8 +184,12 @@ namespace Astroid {
     GError * err = NULL;
     GMimeStream * outs = GMIME_STREAM (g_mime_stream_mem_new ());
 
-    GMimeDecryptResult * decrypt_res = g_mime_crypto_context_decrypt (gpgctx, GMIME_DECRYPT_NONE, NULL,
-        ins, outs, &err);
+    GMimeDecryptResult * decrypt_res;
+    {
+      auto lk = lock_context ();
+      decrypt_res = g_mime_crypto_context_decrypt (gpgctx, GMIME_DECRYPT_NONE, NULL,
+          ins, outs, &err);
+    }
 
     g_mime_stream_flush (outs);
     g_mime_stream_seek (outs, 0, GMIME_STREAM_SEEK_SET);
@@ -196,7 +241,29 @@ namespace Astroid {
 
     verify_tried = true;
 
-    slist = g_mime_multipart_signed_verify (GMIME_MULTIPART_SIGNED(mo), GMIME_VERIFY_NONE, &err);
+    bool use_cache = config.get<bool> ("gpg.cache_signatures");
+    ustring key;
+
+    if (use_cache) {
+      key   = SignatureCache::get_key (mo);
+      slist = SignatureCache::load (key);
+    }
+
+    if (slist == NULL) {
+      {
+# if (GMIME_MAJOR_VERSION < 3)
+        /* gmime 2 runs this operation on the shared context */
+        auto lk = lock_context ();
+# endif
+        slist = g_mime_multipart_signed_verify (GMIME_MULTIPART_SIGNED(mo), GMIME_VERIFY_NONE, &err);
+      }
+
+      if (use_cache && slist != NULL) {
+        SignatureCache::store (key, slist);
+      }
+    } else {
+      LOG (debug) << "crypto: using cached signature verification: " << key;
+    }
 
     verified = verify_signature_list (slist);
 
@@ -237,21 +304,54 @@ namespace Astroid {
       ur.push_back (a.email ());
     }
 
-    LOG (debug) << "cr: encrypting for: ";
+    /* the keys are looked up once (in parallel) and cached, gpg is given
+     * the fingerprints so that it does not have to search the keyring
+     * again. addresses that could not be looked up are passed on. */
+    std::map<ustring, KeyCache::Key> keys;
+    if (astroid->key_cache) {
+      keys = astroid->key_cache->resolve (
+          (astroid->in_test () || gpgpath.empty ()) ? "gpg" : gpgpath, ur);
+    }
+
+    std::vector<ustring> fprs;
+
     for (ustring &u : ur) {
+      auto k = keys.find (u);
+
+      if (k == keys.end ()) {
+        fprs.push_back (u);
+
+      } else if (!k->second.found) {
+        LOG (error) << "crypto: no usable key for: " << u << " (validity: " << k->second.validity << ")";
+        g_set_error (err, g_quark_from_static_string ("astroid-crypto"), 0,
+            "No usable key for: %s", u.c_str ());
+
+        g_ptr_array_free (recpa, true);
+        *out = NULL;
+        return false;
+
+      } else {
+        fprs.push_back (k->second.fingerprint);
+      }
+    }
+
+    LOG (debug) << "cr: encrypting for: ";
+    for (ustring &u : fprs) {
       g_ptr_array_add (recpa, (gpointer) u.c_str ());
       LOG (debug) << u << " ";
     }
 
-    *out = g_mime_multipart_encrypted_encrypt (
-        gpgctx,
-        mo,
-        sign,
-        userid.c_str (),
-        GMIME_ENCRYPT_NONE,
-        recpa,
-        err);
-
+    {
+      auto lk = lock_context ();
+      *out = g_mime_multipart_encrypted_encrypt (
+          gpgctx,
+          mo,
+          sign,
+          userid.c_str (),
+          GMIME_ENCRYPT_NONE,
+          recpa,
+          err);
+    }
 
     g_ptr_array_free (recpa, true);
 
@@ -265,11 +365,14 @@ namespace Astroid {
   }
 
   bool Crypto::sign (GMimeObject * mo, ustring userid, GMimeMultipartSigned ** out, GError ** err) {
-    *out = g_mime_multipart_signed_sign (
-        gpgctx,
-        mo,
-        userid.c_str (),
-        err);
+    {
+      auto lk = lock_context ();
+      *out = g_mime_multipart_signed_sign (
+          gpgctx,
+          mo,
+          userid.c_str (),
+          err);
+    }
 
     if (*out != NULL) {
       LOG (debug) << "crypto: successfully signed message.";
@@ -281,6 +384,20 @@ namespace Astroid {
   }
 
   bool Crypto::create_gpg_context () {
+    std::lock_guard<std::mutex> lk (contexts_m);
+
+    auto it = contexts.find (protocol);
+    if (it != contexts.end ()) {
+      context = it->second;
+      gpgctx  = context->gpgctx;
+
+      return (gpgctx != NULL);
+    }
+
+    context = new Context ();
+    contexts[protocol] = context;
+
+    LOG (debug) << "crypto: creating shared context for: " << protocol;
 
     if (!astroid->in_test ()) {
 
@@ -303,6 +420,8 @@ namespace Astroid {
 # endif
     }
 
+    context->gpgctx = gpgctx;
+
     if (! gpgctx) {
       LOG (error) << "crypto: failed to create gpg context.";
       return false;
@@ -312,6 +431,213 @@ namespace Astroid {
     return true;
   }
 
+  std::unique_lock<std::mutex> Crypto::lock_context () {
+    if (context) return std::unique_lock<std::mutex> (context->lock);
+    else         return std::unique_lock<std::mutex> ();
+  }
+
+  /* deferred operations */
+  void Crypto::decrypt_and_verify_async (GMimeObject * mo, ustring cache_key) {
+    async_cache_key = cache_key;
+    queue_async (mo, true);
+  }
+
+  void Crypto::verify_signature_async (GMimeObject * mo) {
+    queue_async (mo, false);
+  }
+
+  void Crypto::queue_async (GMimeObject * mo, bool decrypt) {
+    LOG (debug) << "crypto: deferring " << (decrypt ? "decryption" : "verification") << " (" << id << ")";
+
+    pending       = true;
+    async_decrypt = decrypt;
+
+    /* the part is read from the same stream as the rest of the message,
+     * which is rendered on the GUI thread while the worker runs. the
+     * worker gets its own copy of the part. */
+    async_object = copy_part (mo);
+
+    if (async_object == NULL) {
+      LOG (error) << "crypto: could not copy part, not deferring (" << id << ")";
+
+      async_object = mo;
+      g_object_ref (async_object);
+
+      async_started = true;
+      run_async ();
+    }
+
+    refptr<Crypto> c = refptr<Crypto> (this);
+    c->reference (); // held by the worker until done
+
+    astroid->crypto_worker->queue (c);
+  }
+
+  GMimeObject * Crypto::copy_part (GMimeObject * mo) {
+    GMimeStream * stream = g_mime_stream_mem_new ();
+    g_mime_object_write_to_stream (mo, NULL, stream);
+    g_mime_stream_seek (stream, 0, GMIME_STREAM_SEEK_SET);
+
+    GMimeParser * parser = g_mime_parser_new_with_stream (stream);
+    GMimeObject * copy   = g_mime_parser_construct_part (parser, NULL);
+
+    g_object_unref (parser);
+    g_object_unref (stream);
+
+    return copy;
+  }
+
+  bool Crypto::start_async () {
+    std::lock_guard<std::mutex> lk (async_m);
+
+    if (async_started || cancelled) return false;
+
+    async_started = true;
+    return true;
+  }
+
+  void Crypto::run_async () {
+    if (async_decrypt) {
+      decrypted_object = decrypt_and_verify (async_object, async_cache_key);
+    } else {
+      verify_signature (async_object);
+    }
+
+    g_object_unref (async_object);
+    async_object = NULL;
+
+    std::unique_lock<std::mutex> lk (async_m);
+    async_finished = true;
+    lk.unlock ();
+
+    async_cv.notify_all ();
+  }
+
+  void Crypto::wait () {
+    if (!pending) return;
+
+    LOG (debug) << "crypto: waiting for deferred operation (" << id << ")";
+
+    std::unique_lock<std::mutex> lk (async_m);
+    if (!async_started) {
+      /* not picked up by any worker yet, run it here */
+      async_started = true;
+      lk.unlock ();
+
+      run_async ();
+    } else {
+      async_cv.wait (lk, [&] { return async_finished; });
+    }
+
+    emit_done ();
+  }
+
+  void Crypto::cancel () {
+    cancelled = true;
+  }
+
+  GMimeObject * Crypto::take_decrypted () {
+    GMimeObject * o = decrypted_object;
+    decrypted_object = NULL;
+    return o;
+  }
+
+  Crypto::type_signal_done Crypto::signal_done () {
+    return m_signal_done;
+  }
+
+  void Crypto::emit_done () {
+    /* either the worker or wait () may finish the operation */
+    if (!pending || cancelled) return;
+
+    pending = false;
+    m_signal_done.emit ();
+  }
+
+  /* crypto worker pool */
+  CryptoWorker::CryptoWorker () {
+    int n = astroid->config ().get<int> ("crypto.gpg.workers");
+
+    d_done.connect (
+        sigc::mem_fun (this, &CryptoWorker::on_done));
+
+    LOG (info) << "crypto: starting " << n << " workers.";
+
+    run = true;
+    for (int i = 0; i < n; i++) {
+      workers.push_back (std::thread (&CryptoWorker::worker, this));
+    }
+  }
+
+  bool CryptoWorker::enabled () {
+    return run && !workers.empty ();
+  }
+
+  void CryptoWorker::queue (refptr<Crypto> c) {
+    std::unique_lock<std::mutex> lk (jobs_m);
+    jobs.push_back (c);
+    lk.unlock ();
+
+    jobs_cv.notify_one ();
+  }
+
+  void CryptoWorker::worker () {
+    std::unique_lock<std::mutex> lk (jobs_m);
+
+    while (run) {
+      jobs_cv.wait (lk, [&] { return !run || !jobs.empty (); });
+      if (!run) break;
+
+      refptr<Crypto> c = jobs.front ();
+      jobs.pop_front ();
+      lk.unlock ();
+
+      if (c->start_async ()) {
+        c->run_async ();
+      }
+
+      /* the Crypto is always released on the GUI thread */
+      std::unique_lock<std::mutex> dlk (done_m);
+      done.push (c);
+      dlk.unlock ();
+      c.reset ();
+
+      d_done.emit ();
+
+      lk.lock ();
+    }
+  }
+
+  void CryptoWorker::on_done () {
+    std::unique_lock<std::mutex> lk (done_m);
+
+    while (!done.empty ()) {
+      refptr<Crypto> c = done.front ();
+      done.pop ();
+      lk.unlock ();
+
+      c->emit_done ();
+
+      lk.lock ();
+    }
+  }
+
+  void CryptoWorker::close () {
+    if (!run) return;
+
+    LOG (debug) << "crypto: stopping workers..";
+
+    std::unique_lock<std::mutex> lk (jobs_m);
+    run = false;
+    jobs.clear ();
+    lk.unlock ();
+
+    jobs_cv.notify_all ();
+
+    for (auto &t : workers) t.join ();
+    workers.clear ();
+  }
+
   ustring Crypto::get_md5_digest (ustring str) {
     std::string cs = Glib::Checksum::compute_checksum (Glib::Checksum::ChecksumType::CHECKSUM_MD5, str);
 
@@ -338,6 +664,531 @@ namespace Astroid {
 
     return Glib::Bytes::create (buffer, len);
   }
-}
 
+  /* signature cache */
+  ustring SignatureCache::keyring_state () {
+    /* the verification result may change if keys are imported, updated or
+     * their trust changes */
+    bfs::path gnupghome;
+    const char * g = getenv ("GNUPGHOME");
+    if (g != NULL) {
+      gnupghome = bfs::path (g);
+    } else {
+      gnupghome = astroid->standard_paths ().home / bfs::path (".gnupg");
+    }
+
+    ustring state;
+
+    for (const char * f : { "pubring.kbx", "pubring.gpg", "trustdb.gpg" }) {
+      bfs::path p = gnupghome / bfs::path (f);
+
+      boost::system::error_code ec;
+      std::time_t mt = bfs::last_write_time (p, ec);
+      if (ec) continue;
+
+      uintmax_t sz = bfs::file_size (p, ec);
+      if (ec) continue;
+
+      state += ustring::compose ("%1:%2:%3;", f, mt, sz);
+    }
+
+    return state;
+  }
+
+  ustring SignatureCache::get_key (GMimeObject * mo) {
+    char * str = g_mime_object_to_string (mo, NULL);
+
+    Glib::Checksum chk (Glib::Checksum::ChecksumType::CHECKSUM_SHA256);
+    chk.update ((const guchar *) str, strlen (str));
+    chk.update (keyring_state ());
+
+    g_free (str);
+
+    return chk.get_string ();
+  }
+
+  GMimeSignatureList * SignatureCache::load (ustring key) {
+    bfs::path p = astroid->standard_paths ().cache_dir / bfs::path ("signatures") / bfs::path (key.c_str ());
+
+    if (!bfs::is_regular_file (p)) return NULL;
+
+    ptree sigs;
+    try {
+      read_json (p.c_str (), sigs);
+    } catch (const boost::property_tree::json_parser::json_parser_error &ex) {
+      LOG (warn) << "crypto: could not read cached signature: " << p.c_str () << ": " << ex.what ();
+      return NULL;
+    }
+
+    /* the modification time is the last time the result was used */
+    boost::system::error_code ec;
+    bfs::last_write_time (p, std::time (NULL), ec);
+
+    GMimeSignatureList * list = g_mime_signature_list_new ();
+
+    for (auto &kv : sigs.get_child ("signatures")) {
+      ptree & sp = kv.second;
+
+      GMimeSignature * s = g_mime_signature_new ();
+      g_mime_signature_set_status (s, (GMimeSignatureStatus) sp.get<int> ("status"));
+
+      GMimeCertificate * ce = g_mime_certificate_new ();
+      g_mime_certificate_set_name (ce, sp.get<std::string> ("name").c_str ());
+      g_mime_certificate_set_email (ce, sp.get<std::string> ("email").c_str ());
+      g_mime_certificate_set_key_id (ce, sp.get<std::string> ("key_id").c_str ());
+      g_mime_certificate_set_fingerprint (ce, sp.get<std::string> ("fingerprint").c_str ());
+
+# if (GMIME_MAJOR_VERSION < 3)
+      g_mime_signature_set_errors (s, (GMimeSignatureError) sp.get<int> ("errors"));
+      g_mime_certificate_set_trust (ce, (GMimeCertificateTrust) sp.get<int> ("trust"));
+# else
+      g_mime_certificate_set_trust (ce, (GMimeTrust) sp.get<int> ("trust"));
+# endif
+
+      g_mime_signature_set_certificate (s, ce);
+      g_object_unref (ce);
+
+      g_mime_signature_list_add (list, s);
+      g_object_unref (s);
+    }
+
+    return list;
+  }
 
+  void SignatureCache::store (ustring key, GMimeSignatureList * list) {
+    if (g_mime_signature_list_length (list) == 0) return;
+
+    ptree sigs;
+    ptree sl;
+
+    for (int i = 0; i < g_mime_signature_list_length (list); i++) {
+      GMimeSignature * s = g_mime_signature_list_get_signature (list, i);
+      GMimeCertificate * ce = g_mime_signature_get_certificate (s);
+
+      if (ce == NULL) return; // do not cache incomplete results
+
+      GMimeSignatureStatus stat = g_mime_signature_get_status (s);
+
+      /* errors from gpg itself may be transient */
+# if (GMIME_MAJOR_VERSION < 3)
+      if (stat == GMIME_SIGNATURE_STATUS_ERROR) return;
+# else
+      if (stat & GMIME_SIGNATURE_STATUS_SYS_ERROR) return;
+# endif
+
+      const char * c = NULL;
+      ptree sp;
+      sp.put ("status", (int) stat);
+      sp.put ("name",   (c = g_mime_certificate_get_name (ce), c ? c : ""));
+      sp.put ("email",  (c = g_mime_certificate_get_email (ce), c ? c : ""));
+      sp.put ("key_id", (c = g_mime_certificate_get_key_id (ce), c ? c : ""));
+      sp.put ("fingerprint", (c = g_mime_certificate_get_fingerprint (ce), c ? c : ""));
+      sp.put ("trust",  (int) g_mime_certificate_get_trust (ce));
+# if (GMIME_MAJOR_VERSION < 3)
+      sp.put ("errors", (int) g_mime_signature_get_errors (s));
+# endif
+
+      sl.push_back (std::make_pair ("", sp));
+    }
+
+    sigs.add_child ("signatures", sl);
+
+    bfs::path dir = astroid->standard_paths ().cache_dir / bfs::path ("signatures");
+    bfs::path p   = dir / bfs::path (key.c_str ());
+    bfs::path tmp = dir / bfs::path ((key + "." + UstringUtils::random_alphanumeric (8) + ".tmp").c_str ());
+
+    try {
+      bfs::create_directories (dir);
+      write_json (tmp.c_str (), sigs);
+      bfs::rename (tmp, p);
+
+    } catch (const std::exception &ex) {
+      LOG (warn) << "crypto: could not store signature in cache: " << ex.what ();
+      boost::system::error_code ec;
+      bfs::remove (tmp, ec);
+    }
+  }
+
+  void SignatureCache::prune () {
+    bfs::path dir = astroid->standard_paths ().cache_dir / bfs::path ("signatures");
+    if (!bfs::is_directory (dir)) return;
+
+    int max_age = astroid->config ().get<int> ("crypto.gpg.cache_signatures_max_age");
+    if (max_age <= 0) return;
+
+    std::time_t limit = std::time (NULL) - max_age * 24 * 3600;
+    int removed = 0;
+
+    try {
+      for (bfs::directory_iterator it (dir), end; it != end; ++it) {
+        boost::system::error_code ec;
+        std::time_t mt = bfs::last_write_time (it->path (), ec);
+
+        /* results keyed on a keyring state that has since changed are
+         * never used again, and expire here */
+        if (!ec && mt < limit) {
+          bfs::remove (it->path (), ec);
+          if (!ec) removed++;
+        }
+      }
+    } catch (const bfs::filesystem_error &ex) {
+      LOG (warn) << "crypto: could not prune signature cache: " << ex.what ();
+    }
+
+    LOG (info) << "crypto: removed " << removed << " expired signatures from cache.";
+  }
+
+  /* decrypted cache */
+  static void secure_wipe (void * p, size_t n) {
+    /* volatile so that the writes are not optimized away */
+    volatile unsigned char * v = (volatile unsigned char *) p;
+    while (n--) *v++ = 0;
+  }
+
+  DecryptedCache::DecryptedCache () {
+    enabled = astroid->config ().get<bool> ("crypto.cache.enabled");
+    ttl     = std::chrono::seconds (astroid->config ().get<int> ("crypto.cache.ttl"));
+
+    if (enabled) {
+      LOG (info) << "crypto: caching decrypted parts for " << ttl.count () << " seconds.";
+
+      purge_timer = Glib::signal_timeout ().connect_seconds (
+          sigc::mem_fun (this, &DecryptedCache::on_purge_timer),
+          std::max (1, std::min (60, (int) ttl.count ())));
+    }
+  }
+
+  DecryptedCache::~DecryptedCache () {
+    purge_timer.disconnect ();
+    clear ();
+  }
+
+  bool DecryptedCache::contains (ustring key) {
+    if (!enabled) return false;
+
+    std::lock_guard<std::mutex> lk (entries_m);
+    purge ();
+
+    return entries.count (key) > 0;
+  }
+
+  GMimeObject * DecryptedCache::get (ustring key, GMimeDecryptResult ** res) {
+    if (!enabled) return NULL;
+
+    std::lock_guard<std::mutex> lk (entries_m);
+    purge ();
+
+    auto it = entries.find (key);
+    if (it == entries.end ()) return NULL;
+
+    Entry & e = it->second;
+
+    /* the part is parsed from (and keeps referring to) a copy of the
+     * content, which is wiped when the stream is freed along with the
+     * part. */
+    GByteArray * array = g_byte_array_sized_new (e.content.size ());
+    g_byte_array_append (array, e.content.data (), e.content.size ());
+
+    GMimeStream * stream = g_mime_stream_mem_new_with_byte_array (array);
+    g_mime_stream_mem_set_owner (GMIME_STREAM_MEM (stream), false);
+    g_object_weak_ref (G_OBJECT (stream), &DecryptedCache::wipe_array, array);
+
+    GMimeParser * parser = g_mime_parser_new_with_stream (stream);
+    GMimeObject * dp     = g_mime_parser_construct_part (parser, NULL);
+
+    g_object_unref (parser);
+    g_object_unref (stream);
+
+    if (dp == NULL) {
+      LOG (error) << "crypto: could not parse cached part: " << key;
+      evict (it);
+      return NULL;
+    }
+
+    if (e.res) g_object_ref (e.res);
+    *res = e.res;
+
+    return dp;
+  }
+
+  void DecryptedCache::insert (ustring key, GMimeObject * dp, GMimeDecryptResult * res) {
+    if (!enabled) return;
+
+    /* the part may contain NUL bytes, so it is written to a stream and
+     * copied with its length */
+    GByteArray  * array  = g_byte_array_new ();
+    GMimeStream * stream = g_mime_stream_mem_new_with_byte_array (array);
+    g_mime_stream_mem_set_owner (GMIME_STREAM_MEM (stream), false);
+
+    ssize_t n = g_mime_object_write_to_stream (dp, NULL, stream);
+    g_object_unref (stream);
+
+    if (n < 0) {
+      wipe_array (array, NULL);
+      return;
+    }
+
+    std::lock_guard<std::mutex> lk (entries_m);
+
+    auto it = entries.find (key);
+    if (it != entries.end ()) evict (it);
+
+    Entry & e = entries[key];
+    e.content.assign (array->data, array->data + array->len);
+    e.res     = res;
+    e.expires = std::chrono::steady_clock::now () + ttl;
+
+    if (e.res) g_object_ref (e.res);
+
+    wipe_array (array, NULL);
+
+    LOG (debug) << "crypto: cached decrypted part: " << key;
+  }
+
+  void DecryptedCache::wipe_array (gpointer data, GObject *) {
+    GByteArray * array = (GByteArray *) data;
+
+    secure_wipe (array->data, array->len);
+    g_byte_array_free (array, true);
+  }
+
+  void DecryptedCache::evict (std::map<ustring, Entry>::iterator it) {
+    Entry & e = it->second;
+
+    secure_wipe (e.content.data (), e.content.size ());
+    if (e.res) g_object_unref (e.res);
+
+    entries.erase (it);
+  }
+
+  void DecryptedCache::purge () {
+    auto now = std::chrono::steady_clock::now ();
+
+    for (auto it = entries.begin (); it != entries.end (); ) {
+      auto next = std::next (it);
+
+      if (it->second.expires <= now) {
+        LOG (debug) << "crypto: evicting cached part: " << it->first;
+        evict (it);
+      }
+
+      it = next;
+    }
+  }
+
+  bool DecryptedCache::on_purge_timer () {
+    std::lock_guard<std::mutex> lk (entries_m);
+    purge ();
+
+    return true;
+  }
+
+  void DecryptedCache::clear () {
+    std::lock_guard<std::mutex> lk (entries_m);
+
+    while (!entries.empty ()) {
+      evict (entries.begin ());
+    }
+  }
+
+  /* key cache */
+  KeyCache::KeyCache () {
+    ttl      = std::chrono::seconds (astroid->config ().get<int> ("crypto.keys.ttl"));
+    parallel = std::max (1, astroid->config ().get<int> ("crypto.keys.parallel"));
+  }
+
+  bool KeyCache::contains (ustring email) {
+    std::lock_guard<std::mutex> lk (entries_m);
+    purge ();
+
+    return entries.count (email.lowercase ()) > 0;
+  }
+
+  std::map<ustring, KeyCache::Key> KeyCache::resolve (ustring gpgpath, std::vector<ustring> emails) {
+    std::map<ustring, Key> keys;
+    std::vector<ustring>   missing;
+
+    {
+      std::lock_guard<std::mutex> lk (entries_m);
+      purge ();
+
+      for (ustring &e : emails) {
+        auto it = entries.find (e.lowercase ());
+
+        if (it != entries.end ()) {
+          if (it->second.key.listed) keys[e] = it->second.key;
+        } else if (std::find (missing.begin (), missing.end (), e) == missing.end ()) {
+          missing.push_back (e);
+        }
+      }
+    }
+
+    if (missing.empty ()) return keys;
+
+    LOG (debug) << "crypto: looking up keys for " << missing.size () << " recipients..";
+
+    std::vector<Key>  found (missing.size ());
+    std::vector<char> ok (missing.size (), false);
+    std::atomic<size_t> next (0);
+
+    auto worker = [&] () {
+      size_t i;
+      while ((i = next++) < missing.size ()) {
+        ok[i] = lookup (gpgpath, missing[i], found[i]);
+      }
+    };
+
+    std::vector<std::thread> lookups;
+    int n = std::min ((int) missing.size (), parallel);
+
+    for (int i = 1; i < n; i++) {
+      lookups.push_back (std::thread (worker));
+    }
+
+    worker ();
+
+    for (auto &t : lookups) t.join ();
+
+    std::lock_guard<std::mutex> lk (entries_m);
+    auto expires = std::chrono::steady_clock::now () + ttl;
+
+    for (size_t i = 0; i < missing.size (); i++) {
+      /* only failed lookups are retried, addresses without keys are
+       * cached until the keyring changes or the entry expires */
+      if (!ok[i]) continue;
+
+      if (found[i].listed) keys[missing[i]] = found[i];
+
+      if (ttl.count () > 0) {
+        Entry & e = entries[missing[i].lowercase ()];
+        e.key     = found[i];
+        e.expires = expires;
+      }
+    }
+
+    return keys;
+  }
+
+  bool KeyCache::lookup (ustring gpgpath, ustring email, Key & key) {
+    /* runs on the lookup threads. <email> makes gpg match the address
+     * exactly rather than as a substring of the user ids */
+    std::vector<std::string> args = { gpgpath, "--batch", "--no-tty",
+      "--with-colons", "--fixed-list-mode", "--list-keys", "--",
+      "<" + email + ">" };
+
+    std::string out, err;
+    int status;
+
+    try {
+      Glib::spawn_sync ("", args, Glib::SPAWN_SEARCH_PATH, sigc::slot <void> (),
+          &out, &err, &status);
+    } catch (Glib::SpawnError &ex) {
+      LOG (warn) << "crypto: could not look up key for: " << email << ": " << ex.what ();
+      return false;
+    }
+
+    /* the first key that can be used for encryption, and that has a user
+     * id with exactly this address, is used. the fingerprint of a key is
+     * listed before its user ids, so each key is only considered when
+     * the next one starts. */
+    ustring address = email.lowercase ();
+
+    bool pub    = false; // the next fingerprint is that of a primary key
+    bool usable = false;
+    bool match  = false;
+    char validity = '-';
+    ustring fingerprint;
+
+    auto done_key = [&] () {
+      if (!match) return;
+
+      if (!key.listed) key.validity = validity;
+      key.listed = true;
+
+      if (usable && !key.found && !fingerprint.empty ()) {
+        key.found       = true;
+        key.fingerprint = fingerprint;
+        key.validity    = validity;
+      }
+    };
+
+    std::vector<std::string> lines;
+    boost::split (lines, out, boost::is_any_of ("\n"));
+
+    for (auto &l : lines) {
+      std::vector<std::string> f;
+      boost::split (f, l, boost::is_any_of (":"));
+
+      if (f[0] == "pub" && f.size () > 11) {
+        done_key ();
+
+        pub   = true;
+        match = false;
+        fingerprint = "";
+
+        validity = f[1].empty () ? '-' : f[1][0];
+
+        /* revoked, expired or invalid keys, or disabled keys */
+        usable = (f[11].find ('E') != std::string::npos) &&
+                 (f[11].find ('D') == std::string::npos) &&
+                 (validity != 'r' && validity != 'e' && validity != 'i');
+
+      } else if (f[0] == "fpr" && pub && f.size () > 9) {
+        pub = false;
+        fingerprint = f[9];
+
+      } else if (f[0] == "uid" && f.size () > 9) {
+        /* revoked or expired user ids do not count */
+        char v = f[1].empty () ? '-' : f[1][0];
+        if (v == 'r' || v == 'e') continue;
+
+        ustring uid = UstringUtils::replace (f[9], "\\x3a", ":");
+        if (Address (uid).email ().lowercase () == address) match = true;
+
+      } else if (f[0] == "sub") {
+        pub = false;
+      }
+    }
+
+    done_key ();
+
+    if (!key.listed) {
+      /* no matching keys: left to gpg when encrypting */
+      LOG (debug) << "crypto: no keys listed for: " << email << " (" << status << ")";
+      return true;
+    }
+
+    LOG (debug) << "crypto: key for: " << email << ": " << (key.found ? key.fingerprint : ustring ("none")) << " (validity: " << key.validity << ")";
+
+    return true;
+  }
+
+  void KeyCache::purge () {
+    /* a new or updated key may change the result of every lookup */
+    ustring state = SignatureCache::keyring_state ();
+
+    if (state != keyring) {
+      if (!entries.empty ()) {
+        LOG (debug) << "crypto: keyring changed, dropping cached keys.";
+      }
+
+      entries.clear ();
+      keyring = state;
+    }
+
+    auto now = std::chrono::steady_clock::now ();
+
+    for (auto it = entries.begin (); it != entries.end (); ) {
+      if (it->second.expires <= now) {
+        it = entries.erase (it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void KeyCache::clear () {
+    std::lock_guard<std::mutex> lk (entries_m);
+    entries.clear ();
+  }
+}
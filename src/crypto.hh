@@ -1,5 +1,15 @@
 # pragma once
 
+# include <map>
+# include <deque>
+# include <queue>
+# include <vector>
+# include <thread>
+# include <mutex>
+# include <atomic>
+# include <chrono>
+# include <condition_variable>
+
 # include <gmime/gmime.h>
 # include <boost/property_tree/ptree.hpp>
 
@@ -22,11 +32,35 @@ namespace Astroid {
       bool isgpg = false;
       bool gpgenabled = true;
 
-      GMimeObject * decrypt_and_verify (GMimeObject * mo);
+      /* if cache_key is set the decrypted part is looked up in and stored
+       * to the decrypted cache */
+      GMimeObject * decrypt_and_verify (GMimeObject * mo, ustring cache_key = "");
       GMimeMessage * decrypt_message (GMimeMessage * in);
 
       bool verify_signature (GMimeObject * mo);
 
+      /* deferred operations: the operation is queued on the crypto worker
+       * pool and signal_done () is emitted on the GUI thread when it has
+       * completed. the result fields below must not be read while pending is
+       * set. */
+      void decrypt_and_verify_async (GMimeObject * mo, ustring cache_key = "");
+      void verify_signature_async (GMimeObject * mo);
+
+      bool pending = false; /* GUI thread only */
+
+      /* finish a pending operation synchronously, running it in this thread
+       * if it has not yet been picked up by a worker. */
+      void wait ();
+
+      /* drop a pending operation that has not yet been started */
+      void cancel ();
+
+      /* result of decrypt_and_verify_async (), caller assumes ownership */
+      GMimeObject * take_decrypted ();
+
+      typedef sigc::signal <void> type_signal_done;
+      type_signal_done signal_done ();
+
       bool encrypt (GMimeObject * mo,
                     bool sign,
                     ustring userid,
@@ -56,8 +90,20 @@ namespace Astroid {
       GMimeCertificateList * rlist       = NULL;
 
     private:
+      /* one gpg context is shared by all Crypto instances of the same
+       * protocol, the lock serializes operations on it. */
+      struct Context {
+        GMimeCryptoContext * gpgctx = NULL;
+        std::mutex           lock;
+      };
+
+      static std::mutex contexts_m;
+      static std::map<ustring, Context *> contexts;
+
       bool create_gpg_context ();
+      Context * context = NULL;
       GMimeCryptoContext * gpgctx = NULL;
+      std::unique_lock<std::mutex> lock_context ();
 
       ustring protocol;
       ustring gpgpath;
@@ -66,11 +112,172 @@ namespace Astroid {
 
       bool verify_signature_list (GMimeSignatureList *);
 
+      /* deferred operation state, shared with the workers */
+      friend class CryptoWorker;
+
+      std::mutex              async_m;
+      std::condition_variable async_cv;
+      bool async_started  = false;
+      bool async_finished = false;
+      bool async_decrypt  = false;
+      std::atomic<bool> cancelled;
+
+      GMimeObject * async_object     = NULL;
+      GMimeObject * decrypted_object = NULL;
+      ustring       async_cache_key;
+
+      /* a copy of the part, independent of the stream of the message */
+      static GMimeObject * copy_part (GMimeObject *);
+
+      void queue_async (GMimeObject *, bool decrypt);
+      bool start_async ();
+      void run_async ();
+      void emit_done ();
+
+      type_signal_done m_signal_done;
+
     public:
+      static void release_contexts ();
+
       static ustring  get_md5_digest (ustring str);
       static gssize   get_md5_length ();
       static refptr<Glib::Bytes> get_md5_digest_b (ustring str);
   };
 
+  /* runs deferred crypto operations on a small pool of worker threads and
+   * hands the finished operations back to the GUI thread. */
+  class CryptoWorker {
+    public:
+      CryptoWorker ();
+
+      void queue (refptr<Crypto>);
+      void close ();
+
+      /* crypto operations may be deferred (crypto.gpg.workers > 0) */
+      bool enabled ();
+
+    private:
+      bool run = false;
+      std::vector<std::thread> workers;
+      void worker ();
+
+      std::mutex jobs_m;
+      std::condition_variable jobs_cv;
+      std::deque<refptr<Crypto>> jobs;
+
+      std::mutex done_m;
+      std::queue<refptr<Crypto>> done;
+
+      Glib::Dispatcher d_done;
+      void on_done ();
+  };
+
+  /* persistent cache of signature verification results (in
+   * <cache_dir>/signatures), keyed by a hash of the signed part (content and
+   * signature) and the state of the keyring. */
+  class SignatureCache {
+    public:
+      static ustring get_key (GMimeObject * signed_part);
+
+      /* returns a signature list rebuilt from the cache, or NULL */
+      static GMimeSignatureList * load (ustring key);
+      static void store (ustring key, GMimeSignatureList *);
+
+      /* remove results that have not been used for
+       * crypto.gpg.cache_signatures_max_age days, and left over temporary
+       * files */
+      static void prune ();
+
+      /* changes when keys are imported or updated, or their trust changes */
+      static ustring keyring_state ();
+  };
+
+  /* opt-in (crypto.cache.enabled) in-memory cache of decrypted parts keyed
+   * by message id and part. entries expire after crypto.cache.ttl seconds,
+   * the decrypted content is wiped from memory when an entry is evicted,
+   * and the copy a part is parsed from when the part is freed. */
+  class DecryptedCache {
+    public:
+      DecryptedCache ();
+      ~DecryptedCache ();
+
+      bool enabled = false;
+
+      bool contains (ustring key);
+
+      /* returns a newly parsed part and a new reference to the decrypt
+       * result, or NULL if there is no valid entry. */
+      GMimeObject * get (ustring key, GMimeDecryptResult ** res);
+      void insert (ustring key, GMimeObject * decrypted, GMimeDecryptResult * res);
+
+      void clear ();
+
+    private:
+      struct Entry {
+        std::vector<unsigned char> content;
+        GMimeDecryptResult *       res = NULL;
+        std::chrono::steady_clock::time_point expires;
+      };
+
+      std::chrono::seconds ttl;
+
+      std::mutex entries_m;
+      std::map<ustring, Entry> entries;
+
+      /* weak reference notify of the streams returned parts are parsed
+       * from */
+      static void wipe_array (gpointer, GObject *);
+
+      /* entries_m must be held */
+      void evict (std::map<ustring, Entry>::iterator);
+      void purge ();
+
+      sigc::connection purge_timer;
+      bool on_purge_timer ();
+  };
+
+  /* cache of recipient key lookups: email address to the fingerprint and
+   * validity of the key to encrypt to. entries expire after
+   * crypto.keys.ttl seconds and are dropped when the keyring changes,
+   * addresses that are not cached are looked up with up to
+   * crypto.keys.parallel gpg processes at the time. */
+  class KeyCache {
+    public:
+      KeyCache ();
+
+      struct Key {
+        bool    found = false;    // a key that can be encrypted to
+        ustring fingerprint;
+        char    validity = '-';   // as listed by gpg --with-colons
+        bool    listed = false;   // gpg listed a key with the address
+      };
+
+      /* keys of the addresses, addresses that could not be looked up
+       * (e.g. gpg could not be run) or that gpg listed no keys for are
+       * left out. the latter are cached as well. */
+      std::map<ustring, Key> resolve (ustring gpgpath, std::vector<ustring> emails);
+
+      bool contains (ustring email);
+      void clear ();
+
+    private:
+      struct Entry {
+        Key key;
+        std::chrono::steady_clock::time_point expires;
+      };
+
+      std::chrono::seconds ttl;
+      int parallel;
+
+      std::mutex entries_m;
+      std::map<ustring, Entry> entries;
+      ustring keyring; // state of the keyring the entries were looked up in
+
+      /* entries_m must be held */
+      void purge ();
+
+      static bool lookup (ustring gpgpath, ustring email, Key &);
+  };
+
 }
 
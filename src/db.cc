@@ -327,6 +327,53 @@ namespace Astroid {
     return _mid;
   }
 
+  ustring Db::index_file (ustring fname, vector<ustring> new_tags) {
+    /* index a file found in the maildirs the way `notmuch new` does: new
+     * messages get new_tags, while for an additional file of a known
+     * message (e.g. a rename) only the maildir flags are applied. */
+    notmuch_message_t * msg;
+
+    notmuch_status_t s = notmuch_database_index_file (nm_db,
+        fname.c_str (),
+        notmuch_database_get_default_indexopts (nm_db),
+        &msg);
+
+    if ((s != NOTMUCH_STATUS_SUCCESS) && (s != NOTMUCH_STATUS_DUPLICATE_MESSAGE_ID)) {
+      if (s == NOTMUCH_STATUS_FILE_ERROR || s == NOTMUCH_STATUS_FILE_NOT_EMAIL) {
+        LOG (warn) << "db: could not index file, ignoring: " << fname << " (" << s << ")";
+        return "";
+      } else {
+        LOG (error) << "db: error indexing file: " << s;
+        throw database_error ("db: could not index file.");
+      }
+    }
+
+    if (s == NOTMUCH_STATUS_SUCCESS) {
+      notmuch_message_freeze (msg);
+
+      for (ustring &t : new_tags) {
+        notmuch_message_add_tag (msg, t.c_str());
+      }
+
+      notmuch_message_thaw (msg);
+    }
+
+    if (maildir_synchronize_flags) {
+      notmuch_message_maildir_flags_to_tags (msg);
+    }
+
+    const char * mid = notmuch_message_get_message_id (msg);
+    ustring _mid;
+
+    if (mid != NULL) {
+      _mid = ustring (mid);
+    }
+
+    notmuch_message_destroy (msg);
+
+    return _mid;
+  }
+
   ustring Db::add_sent_message (ustring fname, vector<ustring> additional_sent_tags, ustring parent_mid) {
     LOG (info) << "db: adding sent message: " << fname;
     additional_sent_tags.insert (additional_sent_tags.end (), sent_tags.begin (), sent_tags.end ());
@@ -361,6 +408,47 @@ namespace Astroid {
   }
 
   ustring Db::add_draft_message (ustring fname) {
+    notmuch_message_t * msg = NULL;
+    notmuch_status_t s = notmuch_database_find_message_by_filename (nm_db, fname.c_str (), &msg);
+
+    if (s == NOTMUCH_STATUS_SUCCESS && msg != NULL) {
+      /* the draft has been written again */
+      LOG (info) << "db: reindexing draft message: " << fname;
+
+# ifdef HAVE_NOTMUCH_INDEX_FILE
+      s = notmuch_message_reindex (msg, notmuch_database_get_default_indexopts (nm_db));
+      if (s != NOTMUCH_STATUS_SUCCESS) {
+        LOG (error) << "db: could not reindex draft message: " << s;
+      }
+
+      /* the draft may have been indexed by someone else first */
+      for (ustring &t : draft_tags) {
+        s = notmuch_message_add_tag (msg, t.c_str ());
+      }
+
+      if ((s == NOTMUCH_STATUS_SUCCESS) && maildir_synchronize_flags) {
+        s = notmuch_message_tags_to_maildir_flags (msg);
+      }
+# else
+      /* notmuch can not reindex the message, add it again instead */
+      notmuch_message_destroy (msg);
+
+      remove_message (fname);
+      return add_message_with_tags (fname, draft_tags);
+# endif
+
+      const char * mid = notmuch_message_get_message_id (msg);
+      ustring _mid;
+
+      if (mid != NULL) {
+        _mid = ustring (mid);
+      }
+
+      notmuch_message_destroy (msg);
+
+      return _mid;
+    }
+
     LOG (info) << "db: adding draft message: " << fname;
     return add_message_with_tags (fname, draft_tags);
   }
@@ -147,6 +147,7 @@ namespace Astroid {
       ustring add_sent_message (ustring, std::vector<ustring>, ustring);
       ustring add_draft_message (ustring);
       ustring add_message_with_tags (ustring fname, std::vector<ustring> tags);
+      ustring index_file (ustring fname, std::vector<ustring> new_tags);
       bool remove_message (ustring);
 
       static ustring sanitize_tag (ustring);
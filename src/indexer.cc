@@ -0,0 +1,269 @@
+# include <vector>
+# include <algorithm>
+# include <chrono>
+
+# include <boost/filesystem.hpp>
+# include <notmuch.h>
+
+# include "astroid.hh"
+# include "indexer.hh"
+# include "db.hh"
+# include "account_manager.hh"
+# include "utils/vector_utils.hh"
+
+using namespace std;
+using namespace boost::filesystem;
+
+namespace Astroid {
+  Indexer::Indexer () {
+    LOG (info) << "indexer: setting up.";
+
+    running = false;
+    cancel  = false;
+
+    batch_size = astroid->config ().get<int> ("poll.indexer.batch");
+    debounce   = astroid->config ().get<int> ("poll.indexer.debounce");
+    transaction_time = astroid->config ().get<int> ("poll.indexer.transaction_time");
+    if (batch_size <= 0) batch_size = 1;
+
+    /* tags for new messages, as for `notmuch new` */
+    ustring new_tags_s = astroid->notmuch_config ().get<string> ("new.tags", "unread;inbox;");
+    new_tags = VectorUtils::split_and_trim (new_tags_s, ";");
+    new_tags.erase (std::remove_if (new_tags.begin (), new_tags.end (),
+          [] (ustring &t) { return t.empty (); }), new_tags.end ());
+
+    d_indexed.connect (sigc::mem_fun (this, &Indexer::on_indexed));
+
+    watch_maildirs ();
+  }
+
+  Indexer::~Indexer () {
+    close ();
+  }
+
+  void Indexer::close () {
+    c_debounce.disconnect ();
+
+    for (auto &m : monitors) {
+      m->cancel ();
+    }
+
+    monitors.clear ();
+
+    cancel = true;
+    if (worker_t.joinable ()) {
+      worker_t.join ();
+    }
+  }
+
+  void Indexer::watch_maildirs () {
+    /* drafts are added to the db with the draft tags when they are saved,
+     * they should not be indexed as new messages. */
+    std::vector<path> drafts;
+    for (auto &a : astroid->accounts->accounts) {
+      if (!a.save_drafts_to.empty ()) drafts.push_back (a.save_drafts_to);
+    }
+
+    try {
+      for (recursive_directory_iterator it (Db::path_db), end; it != end; ++it) {
+        if (!is_directory (it->status ())) continue;
+
+        ustring name = it->path ().filename ().string ();
+
+        if (name == ".notmuch" || name == "tmp") {
+          it.no_push ();
+          continue;
+        }
+
+        if (std::any_of (drafts.begin (), drafts.end (),
+              [&] (path &d) {
+                boost::system::error_code ec;
+                return equivalent (d, it->path (), ec);
+              })) {
+          it.no_push ();
+          continue;
+        }
+
+        if (name == "cur" || name == "new") {
+          auto m = Gio::File::create_for_path (it->path ().c_str ())->monitor_directory (
+              Gio::FILE_MONITOR_WATCH_MOVES);
+          m->signal_changed ().connect (sigc::mem_fun (this, &Indexer::on_event));
+          monitors.push_back (m);
+
+          it.no_push ();
+        }
+      }
+    } catch (filesystem_error &ex) {
+      LOG (error) << "indexer: could not set up maildir watches: " << ex.what ();
+    }
+
+    LOG (info) << "indexer: watching " << monitors.size () << " maildir directories.";
+  }
+
+  void Indexer::on_event (
+      const refptr<Gio::File> & f,
+      const refptr<Gio::File> & other,
+      Gio::FileMonitorEvent ev)
+  {
+    /* temporary files (e.g. drafts being written) */
+    std::string name = f->get_basename ();
+    if (!name.empty () && name[0] == '.') return;
+
+    std::lock_guard<std::mutex> lk (m_queue);
+
+    switch (ev) {
+      case Gio::FILE_MONITOR_EVENT_CREATED:
+      case Gio::FILE_MONITOR_EVENT_MOVED_IN:
+        to_add.push_back (f->get_path ());
+        break;
+
+      case Gio::FILE_MONITOR_EVENT_DELETED:
+      case Gio::FILE_MONITOR_EVENT_MOVED_OUT:
+        to_remove.push_back (f->get_path ());
+        break;
+
+      case Gio::FILE_MONITOR_EVENT_RENAMED:
+        /* the new file is added before the old one is removed so that
+         * the message and its tags are kept */
+        to_add.push_back (other->get_path ());
+        to_remove.push_back (f->get_path ());
+        break;
+
+      default:
+        return;
+    }
+
+    c_debounce.disconnect ();
+    c_debounce = Glib::signal_timeout ().connect (
+        sigc::mem_fun (this, &Indexer::on_debounced), debounce);
+  }
+
+  bool Indexer::on_debounced () {
+    std::lock_guard<std::mutex> lk (m_queue);
+
+    if (!running && !cancel) {
+      if (worker_t.joinable ()) worker_t.join ();
+
+      running  = true;
+      worker_t = std::thread (&Indexer::worker, this);
+    }
+
+    return false;
+  }
+
+  void Indexer::worker () {
+    while (!cancel) {
+      vector<ustring> add, remove;
+
+      {
+        std::lock_guard<std::mutex> lk (m_queue);
+
+        /* all queued additions are done before removals, so that a file
+         * that is renamed is never the last file of its message */
+        if (!to_add.empty ()) {
+          while (!to_add.empty () && static_cast<int>(add.size ()) < batch_size) {
+            add.push_back (to_add.front ());
+            to_add.pop_front ();
+          }
+        } else {
+          while (!to_remove.empty () && static_cast<int>(remove.size ()) < batch_size) {
+            remove.push_back (to_remove.front ());
+            to_remove.pop_front ();
+          }
+        }
+
+        if (add.empty () && remove.empty ()) {
+          running = false;
+          return;
+        }
+      }
+
+      LOG (debug) << "indexer: indexing " << add.size () << " new and " << remove.size () << " removed files..";
+
+      unsigned long revision;
+      size_t added = 0, removed = 0;
+
+      {
+        Db db (Db::DbMode::DATABASE_READ_WRITE);
+        revision = db.get_revision ();
+
+        /* the transaction is ended early when it takes too long, the rest
+         * of the batch is put back in the queue and indexed after the
+         * database has been released. */
+        auto deadline = std::chrono::steady_clock::now () +
+          std::chrono::milliseconds (transaction_time);
+
+        auto expired = [&] () {
+          return transaction_time > 0 && std::chrono::steady_clock::now () >= deadline;
+        };
+
+        notmuch_database_begin_atomic (db.nm_db);
+
+        for (; added < add.size () && !(added > 0 && expired ()); added++) {
+          auto &f = add[added];
+          try {
+            db.index_file (f, new_tags);
+          } catch (database_error &ex) {
+            LOG (error) << "indexer: " << f << ": " << ex.what ();
+          }
+        }
+
+        for (; removed < remove.size () && !(removed > 0 && expired ()); removed++) {
+          auto &f = remove[removed];
+          try {
+            db.remove_message (f);
+          } catch (database_error &ex) {
+            LOG (error) << "indexer: " << f << ": " << ex.what ();
+          }
+        }
+
+        notmuch_status_t s = notmuch_database_end_atomic (db.nm_db);
+        if (s != NOTMUCH_STATUS_SUCCESS) {
+          LOG (error) << "indexer: could not commit batch: " << s;
+        }
+      }
+
+      if (added < add.size () || removed < remove.size ()) {
+        LOG (debug) << "indexer: transaction took more than " << transaction_time << " ms, requeuing " << (add.size () - added + remove.size () - removed) << " files.";
+
+        std::lock_guard<std::mutex> lk (m_queue);
+        to_add.insert (to_add.begin (), add.begin () + added, add.end ());
+        to_remove.insert (to_remove.begin (), remove.begin () + removed, remove.end ());
+      }
+
+      {
+        std::lock_guard<std::mutex> lk (m_indexed);
+        indexed.push_back (revision);
+      }
+
+      d_indexed.emit ();
+
+      /* let anyone waiting for the database open it before the next
+       * transaction */
+      std::this_thread::yield ();
+    }
+
+    std::lock_guard<std::mutex> lk (m_queue);
+    running = false;
+  }
+
+  void Indexer::on_indexed () {
+    unsigned long revision;
+
+    {
+      std::lock_guard<std::mutex> lk (m_indexed);
+      if (indexed.empty ()) return;
+
+      revision = *std::min_element (indexed.begin (), indexed.end ());
+      indexed.clear ();
+    }
+
+    LOG (info) << "indexer: indexed changes since revision: " << revision;
+    m_signal_indexed.emit (revision);
+  }
+
+  Indexer::type_signal_indexed Indexer::signal_indexed () {
+    return m_signal_indexed;
+  }
+}
+
@@ -0,0 +1,69 @@
+# pragma once
+
+# include <vector>
+# include <deque>
+# include <thread>
+# include <mutex>
+# include <atomic>
+
+# include <giomm/filemonitor.h>
+
+# include "astroid.hh"
+# include "proto.hh"
+
+namespace Astroid {
+  /* indexes new, moved and removed files in the maildirs as they
+   * happen, instead of having `notmuch new` scan all the maildirs
+   * (poll.indexer.enable). changes are collected from file monitors
+   * on the cur/ and new/ directories of the maildirs and indexed in
+   * batches on a worker thread. each batch is limited in both size and
+   * time, and the database is closed between them so that it can be
+   * opened by the GUI. */
+  class Indexer {
+    public:
+      Indexer ();
+      ~Indexer ();
+
+      void close ();
+
+      /* emitted on the GUI thread when a batch has been indexed, with
+       * the revision of the database before the batch */
+      typedef sigc::signal <void, unsigned long> type_signal_indexed;
+      type_signal_indexed signal_indexed ();
+
+    private:
+      int batch_size;
+      int transaction_time; // ms
+      int debounce; // ms
+
+      std::vector<ustring> new_tags;
+
+      std::vector<refptr<Gio::FileMonitor>> monitors;
+      void watch_maildirs ();
+      void on_event (
+          const refptr<Gio::File> &,
+          const refptr<Gio::File> &,
+          Gio::FileMonitorEvent);
+
+      /* queued changes, paths of files to add and remove */
+      std::mutex          m_queue;
+      std::deque<ustring> to_add;
+      std::deque<ustring> to_remove;
+
+      sigc::connection c_debounce;
+      bool on_debounced ();
+
+      std::thread       worker_t;
+      std::atomic<bool> running;
+      std::atomic<bool> cancel;
+      void worker ();
+
+      std::mutex                 m_indexed;
+      std::deque<unsigned long>  indexed;
+      Glib::Dispatcher d_indexed;
+      void on_indexed ();
+
+      type_signal_indexed m_signal_indexed;
+  };
+}
+
@@ -21,6 +21,7 @@
 # include "modes/help_mode.hh"
 # include "modes/edit_message.hh"
 # include "modes/log_view.hh"
+# include "modes/outbox_view.hh"
 # include "command_bar.hh"
 # include "actions/action.hh"
 # include "actions/action_manager.hh"
@@ -360,6 +361,13 @@ namespace Astroid {
           return true;
         });
 
+    keys.register_key ("Z", "main_window.show_outbox",
+        "Show outbox",
+        [&] (Key) {
+          add_mode (new OutboxView (this));
+          return true;
+        });
+
     keys.register_key ("u", "main_window.undo",
         "Undo last action",
         [&] (Key) {
@@ -8,6 +8,7 @@
 
 # include "astroid.hh"
 # include "db.hh"
+# include "poll.hh"
 # include "message_thread.hh"
 # include "chunk.hh"
 # include "utils/utils.hh"
@@ -74,8 +75,9 @@ namespace Astroid {
     tags = nmmsg->tags;
   }
 
-  Message::Message (refptr<NotmuchMessage> _msg, int _level) : Message () {
+  Message::Message (refptr<NotmuchMessage> _msg, int _level, bool _defer_crypto) : Message () {
     in_notmuch = true;
+    defer_crypto = _defer_crypto; // must be set before load_message_from_file
     nmmsg = _msg;
     mid = nmmsg->mid;
     tid = nmmsg->thread_id;
@@ -316,10 +318,27 @@ namespace Astroid {
       time = 0;
     }
 
-    root = refptr<Chunk>(new Chunk (g_mime_message_get_mime_part (message)));
+    Chunk::Options opts;
+    opts.defer_crypto = defer_crypto;
+    opts.mid          = mid;
+
+    root = refptr<Chunk>(new Chunk (g_mime_message_get_mime_part (message), opts));
+
+    if (defer_crypto) {
+      root->signal_crypto_done ().connect (
+          sigc::mem_fun (this, &Message::on_crypto_done));
+    }
+  }
+
+  void Message::on_crypto_done () {
+    emit_message_changed (NULL, MessageChangedEvent::MESSAGE_CRYPTO_DONE);
   }
 
-  ustring Message::plain_text (bool fallback_html) {
+  void Message::wait_for_crypto () {
+    if (root) root->wait_for_crypto ();
+  }
+
+  ustring Message::plain_text (bool fallback_html, ustring_sz max_length) {
     if (missing_content) {
       LOG (warn) << "message: missing content, no text.";
       return "";
@@ -330,6 +349,8 @@ namespace Astroid {
     function< void (refptr<Chunk>) > app_body =
       [&] (refptr<Chunk> c)
     {
+      if (max_length != ustring::npos && body.size () >= max_length) return;
+
       /* check if we're the preferred sibling */
       bool use = false;
 
@@ -353,7 +374,11 @@ namespace Astroid {
       if (use) {
         if (c->viewable && (c->is_content_type ("text", "plain") || fallback_html)) {
           /* will output html if HTML part */
-          body += c->viewable_text (false);
+          if (max_length == ustring::npos) {
+            body += c->viewable_text (false);
+          } else {
+            body += c->viewable_text (false, false, max_length - body.size ());
+          }
         }
 
         for_each (c->kids.begin(),
@@ -1001,6 +1026,7 @@ namespace Astroid {
   }
 
   void MessageThread::on_thread_updated (Db * db, ustring tid) {
+    PollListenerTimer t ("message_thread");
     if (in_notmuch && tid == thread->thread_id) {
       in_notmuch = thread->refresh (db);
       if (in_notmuch) {
@@ -1021,6 +1047,7 @@ namespace Astroid {
   }
 
   void MessageThread::on_thread_changed (Db * db, ustring tid) {
+    PollListenerTimer t ("message_thread");
     if (in_notmuch && tid == thread->thread_id) {
       thread->refresh (db);
     }
@@ -1031,13 +1058,13 @@ namespace Astroid {
     else return false;
   }
 
-  void MessageThread::load_messages (Db * db) {
+  void MessageThread::load_messages (Db * db, bool defer_crypto) {
     /* update values */
     subject = thread->subject;
     set_first_subject (thread->subject);
 
     for (auto &mm : thread->messages (db)) {
-      auto m = refptr<Message>(new Message (mm.second, mm.first));
+      auto m = refptr<Message>(new Message (mm.second, mm.first, defer_crypto));
       if (!first_subject_set) set_first_subject(m->subject);
 
       m->subject_is_different = subject_is_different (m->subject);
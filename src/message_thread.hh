@@ -18,7 +18,7 @@ namespace Astroid {
       Message (notmuch_message_t *, int _level);
       Message (GMimeMessage *);
       Message (GMimeStream *);
-      Message (refptr<NotmuchMessage>, int _level = 0);
+      Message (refptr<NotmuchMessage>, int _level = 0, bool _defer_crypto = false);
       ~Message ();
 
       ustring fname;
@@ -67,7 +67,8 @@ namespace Astroid {
       ustring pretty_verbose_date (bool include_short = false);
       std::vector<ustring> tags;
 
-      ustring plain_text (bool fallback_html = false);
+      /* stops decoding parts once max_length characters have been read */
+      ustring plain_text (bool fallback_html = false, ustring_sz max_length = ustring::npos);
       std::vector<refptr<Chunk>> attachments ();
       refptr<Chunk> get_chunk_by_id (int id);
 
@@ -91,6 +92,10 @@ namespace Astroid {
 
       GMimeMessage * decrypt ();
 
+      /* finish deferred decryption and verification, needed before the
+       * content is used for e.g. replying */
+      void wait_for_crypto ();
+
       void save ();
       void save_to (ustring);
 
@@ -98,6 +103,7 @@ namespace Astroid {
       typedef enum {
         MESSAGE_TAGS_CHANGED,
         MESSAGE_REMOVED,
+        MESSAGE_CRYPTO_DONE, /* deferred decryption or verification finished */
       } MessageChangedEvent;
 
       typedef sigc::signal <void, Db *, Message *, MessageChangedEvent> type_signal_message_changed;
@@ -109,6 +115,10 @@ namespace Astroid {
 
       bool subject_is_different = true;
       bool process = true;
+
+      /* queue decryption and verification on the crypto workers */
+      bool defer_crypto = false;
+      void on_crypto_done ();
   };
 
   /* exceptions */
@@ -153,7 +163,7 @@ namespace Astroid {
 
       std::vector<refptr<Message>> messages_by_time ();
 
-      void load_messages (Db *);
+      void load_messages (Db *, bool defer_crypto = false);
       void add_message (ustring);
       void add_message (refptr<Chunk>);
       void add_message (refptr<Message>);
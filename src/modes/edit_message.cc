@@ -4,6 +4,8 @@
 # include <random>
 # include <ctime>
 # include <memory>
+# include <fcntl.h>
+# include <unistd.h>
 
 # include <gtkmm.h>
 
@@ -14,6 +16,7 @@
 # include "account_manager.hh"
 # include "edit_message.hh"
 # include "compose_message.hh"
+# include "outbox.hh"
 # include "db.hh"
 # include "thread_view/thread_view.hh"
 # include "raw_message.hh"
@@ -99,6 +102,10 @@ namespace Astroid {
     embed_editor = !editor_config.get<bool> ("external_editor");
 # endif
     save_draft_on_force_quit = editor_config.get <bool> ("save_draft_on_force_quit");
+    autosave_draft           = editor_config.get <bool> ("autosave_draft");
+    autosave_draft_delay     = editor_config.get <int> ("autosave_draft_delay");
+
+    d_draft_written.connect (sigc::mem_fun (this, &EditMessage::on_draft_written));
 
     ustring attachment_words_s = editor_config.get<string> ("attachment_words");
     attachment_words = VectorUtils::split_and_trim (attachment_words_s.lowercase (), ",");
@@ -337,15 +344,21 @@ namespace Astroid {
         [&] (Key) {
           /* view raw source of to be sent message */
           auto c = make_message ();
+          auto m = load_preview (c.get ());
 
-          GMimeStream * m = g_mime_stream_mem_new ();
-          assert (g_mime_stream_mem_get_owner (GMIME_STREAM_MEM(m)) == true);
-          c->write (m);
-
-          main_window->add_mode (new RawMessage (main_window, refptr<Message>(new UnprocessedMessage(m))));
+          if (m) main_window->add_mode (new RawMessage (main_window, m));
 
-          g_object_unref (m);
+          return true;
+        });
 
+    keys.register_key ("p", "edit_message.preview",
+        "Preview message with encryption and signature",
+        [&] (Key) {
+          if (!message_sent && !sending_in_progress.load () && !in_read) {
+            preview_crypto = true;
+            read_edited_message ();
+            preview_crypto = false;
+          }
           return true;
         });
 
@@ -428,7 +441,7 @@ namespace Astroid {
 
             bool r;
 
-            r = save_draft ();
+            r = save_draft () && flush_draft ();
 
             if (!r) {
               on_tv_ready ();
@@ -534,6 +547,10 @@ namespace Astroid {
   EditMessage::~EditMessage () {
     LOG (debug) << "em: deconstruct.";
 
+    /* queued drafts are written before the editor goes away */
+    c_autosave.disconnect ();
+    flush_draft ();
+
     if (status_icon_visible) {
       main_window->notebook.remove_widget (&message_sending_status_icon);
     }
@@ -563,7 +580,7 @@ namespace Astroid {
     } else if (force && !message_sent && !draft_saved && save_draft_on_force_quit) {
 
       LOG (warn) << "em: force quit, trying to save draft..";
-      bool r = save_draft ();
+      bool r = save_draft () && flush_draft ();
       if (!r) {
         LOG (error) << "em: cannot save draft! check account config. changes will be lost.";
       }
@@ -582,7 +599,11 @@ namespace Astroid {
     auto c = make_draft_message ();
     ustring fname;
 
-    bool add_to_notmuch = false;
+    if (!c->attachments_success) {
+      LOG (error) << "em: draft not saved: " << c->attachments_error;
+      set_warning ("draft could not be saved, failed adding attachments: " + UstringUtils::replace (c->attachments_error, "\n", "<br />"));
+      return false;
+    }
 
     if (!draft_msg) {
       /* make new message */
@@ -597,27 +618,184 @@ namespace Astroid {
         /* msg_id might come from external client or server */
         ddir = ddir / path(Utils::safe_fname (msg_id));
         fname = ddir.c_str ();
-
-        add_to_notmuch = true;
       }
     } else {
       fname = draft_msg->fname; // overwrite
     }
 
-    c->write (fname);
+    /* the draft is not written again if it has not changed since the
+     * last one that was queued */
+    ustring hash = get_preview_input (c.get ());
+
+    std::lock_guard<std::mutex> lk (draft_m);
+
+    if (hash == draft_hash) {
+      LOG (info) << "em: draft unchanged.";
+      draft_queued.reset ();
+      draft_saved = true;
+      return true;
+    }
+
+    if (draft_queued) {
+      LOG (debug) << "em: replacing queued draft.";
+    }
+
+    draft_queued.reset (new DraftWrite ());
+    draft_queued->c     = std::move (c);
+    draft_queued->fname = fname;
+    draft_queued->hash  = hash;
+    draft_hash = hash;
 
-    LOG (info) << "em: saved draft to: " << fname;
+    if (!draft_running) {
+      if (draft_t.joinable ()) draft_t.join ();
 
-    if (add_to_notmuch) {
-      astroid->actions->doit (refptr<Action> (
-            new AddDraftMessage (fname)));
+      draft_running = true;
+      draft_t = std::thread (&EditMessage::draft_worker, this);
     }
 
     draft_saved = true;
     return true;
   }
 
+  bool EditMessage::flush_draft () {
+    /* the worker exits when there are no more queued drafts */
+    if (draft_t.joinable ()) draft_t.join ();
+
+    on_draft_written ();
+
+    return draft_saved;
+  }
+
+  void EditMessage::draft_worker () {
+    while (true) {
+      std::unique_ptr<DraftWrite> d;
+
+      {
+        std::lock_guard<std::mutex> lk (draft_m);
+        if (!draft_queued) {
+          draft_running = false;
+          return;
+        }
+
+        d = std::move (draft_queued);
+      }
+
+      write_draft (*d);
+
+      {
+        std::lock_guard<std::mutex> lk (draft_m);
+        draft_written.push_back (std::move (d));
+      }
+
+      d_draft_written.emit ();
+    }
+  }
+
+  void EditMessage::write_draft (DraftWrite & d) {
+    /* runs on the draft worker: the draft is written to a temporary file
+     * which replaces the draft when it is complete. in a maildir the
+     * temporary file is put in tmp/, so that it is never mistaken for a
+     * message. */
+    path target (d.fname.c_str ());
+    path dir = target.parent_path ();
+    path tmp;
+
+    if ((dir.filename () == "cur" || dir.filename () == "new") &&
+        is_directory (dir.parent_path () / path ("tmp"))) {
+      tmp = dir.parent_path () / path ("tmp") / target.filename ();
+    } else {
+      tmp = dir / path ("." + target.filename ().string () + ".tmp");
+    }
+
+    GError * err = NULL;
+    GMimeStream * stream = g_mime_stream_fs_open (tmp.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0600, &err);
+
+    if (stream == NULL) {
+      d.error = err ? err->message : "could not open file";
+      if (err) g_error_free (err);
+      return;
+    }
+
+    d.c->write (stream);
+    bool synced = (fsync (GMIME_STREAM_FS (stream)->fd) == 0);
+    g_object_unref (stream);
+
+    boost::system::error_code ec;
+
+    if (!synced) {
+      d.error = "could not write file";
+      boost::filesystem::remove (tmp, ec);
+      return;
+    }
+
+    rename (tmp, target, ec);
+
+    if (ec) {
+      d.error = ec.message ();
+      boost::filesystem::remove (tmp, ec);
+      return;
+    }
+
+    d.success = true;
+  }
+
+  void EditMessage::on_draft_written () {
+    std::vector<std::unique_ptr<DraftWrite>> written;
+
+    {
+      std::lock_guard<std::mutex> lk (draft_m);
+      written.swap (draft_written);
+    }
+
+    for (auto &d : written) {
+      if (d->success) {
+        LOG (info) << "em: saved draft to: " << d->fname;
+
+        /* the draft is added, or reindexed if it was already there */
+        astroid->actions->doit (refptr<Action> (
+              new AddDraftMessage (d->fname)));
+
+        if (!draft_msg) {
+          /* deleted when the message is sent */
+          draft_msg = refptr<Message> (new UnprocessedMessage (msg_id, d->fname));
+        }
+
+      } else {
+        LOG (error) << "em: could not save draft to: " << d->fname << ": " << d->error;
+        set_warning ("draft could not be saved: " + d->error);
+
+        draft_saved = false;
+        draft_hash  = "";
+      }
+    }
+
+    /* the composed messages are released on the GUI thread */
+    written.clear ();
+  }
+
+  void EditMessage::queue_autosave () {
+    if (!autosave_draft || message_sent) return;
+
+    /* rapid changes are saved once */
+    c_autosave.disconnect ();
+    c_autosave = Glib::signal_timeout ().connect (
+        sigc::mem_fun (this, &EditMessage::on_autosave), autosave_draft_delay);
+  }
+
+  bool EditMessage::on_autosave () {
+    if (!editor_active && !message_sent && !sending_in_progress.load () && !draft_saved) {
+      LOG (info) << "em: autosaving draft..";
+      save_draft ();
+    }
+
+    return false;
+  }
+
   void EditMessage::delete_draft () {
+    /* a draft being written would be added back */
+    c_autosave.disconnect ();
+    flush_draft ();
+
     if (draft_msg) {
 
       delete_draft (draft_msg);
@@ -785,15 +963,25 @@ namespace Astroid {
     /* set account selector to from address email */
     set_from (c->account);
 
-    /* build message */
-    finalize_message (c);
+    /* build message, it is only encrypted or signed when it is sent or
+     * when a preview of it is requested */
+    finalize_message (c, !preview_crypto);
 
     if (c->markdown && !c->markdown_success) {
       set_warning ("Failed processing markdown: " + UstringUtils::replace (c->markdown_error, "\n", "<br />"));
     }
 
+    if (!c->attachments_success) {
+      set_warning ("Failed adding attachments: " + UstringUtils::replace (c->attachments_error, "\n", "<br />"));
+    }
+
     if (c->encrypt || c->sign) {
-      if (!c->encryption_success) {
+      if (c->defer_crypto) {
+        if (!editor_active) {
+          set_info (ustring::compose ("The message will be %1 when it is sent, preview with 'p'.",
+                c->encrypt ? "encrypted" : "signed"));
+        }
+      } else if (!c->encryption_success) {
         set_warning ("Failed encrypting: " + UstringUtils::replace (c->encryption_error, "\n", "<br />"));
       }
     }
@@ -806,19 +994,85 @@ namespace Astroid {
     subject = c->subject;
     body = ustring(c->body.str());
 
-    GMimeStream * m = g_mime_stream_mem_new ();
-    assert (g_mime_stream_mem_get_owner (GMIME_STREAM_MEM(m)) == true);
-    c->write (m);
+    /* the message is only rendered again if it has changed */
+    ustring input = get_preview_input (c.get ());
 
-    auto msgt = refptr<MessageThread>(new MessageThread());
-    msgt->add_message (refptr<Message>(new UnprocessedMessage(m)));
-    thread_view->load_message_thread (msgt);
+    if (input != preview_input) {
+      auto m = load_preview (c.get ());
 
-    g_object_unref (m);
+      if (m) {
+        auto msgt = refptr<MessageThread>(new MessageThread());
+        msgt->add_message (m);
+        thread_view->load_message_thread (msgt);
+
+        preview_input = input;
+      }
+    } else {
+      LOG (debug) << "em: message unchanged, keeping preview.";
+    }
 
     in_read = false;
   }
 
+  refptr<Message> EditMessage::load_preview (ComposeMessage * c) {
+    /* the message is written to a temporary file and parsed from there,
+     * the parts stay on disk (in the unlinked file) so that the
+     * attachments are not kept in memory. */
+    ustring fname = c->write_tmp ();
+
+    GError * err = NULL;
+    GMimeStream * s = g_mime_stream_fs_open (fname.c_str (), O_RDONLY, 0, &err);
+    unlink (fname.c_str ());
+
+    if (s == NULL) {
+      LOG (error) << "em: could not open preview: " << fname << ": " << (err ? err->message : "unknown error");
+      if (err) g_error_free (err);
+      set_warning ("Could not load message preview.");
+      return refptr<Message> ();
+    }
+
+    refptr<Message> m (new UnprocessedMessage (s));
+    g_object_unref (s);
+
+    return m;
+  }
+
+  ustring EditMessage::get_preview_input (ComposeMessage * c) {
+    /* everything that the rendered message depends on, except for the
+     * date */
+    Glib::Checksum chk (Glib::Checksum::ChecksumType::CHECKSUM_SHA256);
+
+    for (auto &f : { c->account->email, c->to, c->cc, c->bcc, c->subject,
+                     c->references, c->inreplyto, ustring (c->body.str ()) }) {
+      chk.update (f + "\n");
+    }
+
+    chk.update (ustring::compose ("%1:%2:%3:%4:%5:%6:%7\n",
+          c->include_signature, c->markdown, c->markdown_success,
+          c->encrypt, c->sign, c->defer_crypto, c->encryption_success));
+
+    if (c->include_signature) {
+      chk.update (ustring::compose ("%1:%2:", c->account->signature_attach,
+            c->account->signature_separate));
+      chk.update (ComposeMessage::file_state (c->account->signature_file));
+    }
+
+    if (c->markdown) {
+      chk.update (astroid->config ().get<string> ("editor.markdown_processor") + "\n");
+    }
+
+    for (auto &a : c->attachments) {
+      chk.update (ustring::compose ("%1:%2:%3:%4\n",
+            a->name, a->fname.c_str (), a->chunk_id, a.get ()));
+
+      if (!a->fname.empty ()) {
+        chk.update (ComposeMessage::file_state (a->fname));
+      }
+    }
+
+    return chk.get_string ();
+  }
+
   /* }}} */
 
   void EditMessage::set_info (ustring msg) {
@@ -915,8 +1169,10 @@ namespace Astroid {
 
         fields_show ();
 
-        if (editor_active)
+        if (editor_active) {
           read_edited_message ();
+          queue_autosave ();
+        }
 
         editor_active = false;
 
@@ -943,6 +1199,7 @@ namespace Astroid {
 
         if (editor_active) {
           read_edited_message ();
+          queue_autosave ();
         }
 
         editor_active = false;
@@ -1067,6 +1324,10 @@ namespace Astroid {
 
     on_tv_ready ();
 
+    /* a draft still being written is deleted once the message is sent */
+    c_autosave.disconnect ();
+    flush_draft ();
+
     auto c = make_message ();
 
     if (c == NULL) return false;
@@ -1076,6 +1337,11 @@ namespace Astroid {
       return false;
     }
 
+    if (!c->attachments_success) {
+      set_warning ("Cannot send, failed adding attachments: " + UstringUtils::replace (c->attachments_error, "\n", "<br />"));
+      return false;
+    }
+
     if (c->encrypt || c->sign) {
       if (!c->encryption_success) {
         set_warning ("Cannot send, failed encrypting: " + UstringUtils::replace (c->encryption_error, "\n", "<br />"));
@@ -1083,6 +1349,12 @@ namespace Astroid {
       }
     }
 
+    /* a message that failed to send earlier is still in the outbox */
+    if (!astroid->outbox->remove (c->id)) {
+      set_warning ("Cannot send, the message is being sent from the outbox.");
+      return false;
+    }
+
     c->message_sent().connect (
         sigc::mem_fun (this, &EditMessage::send_message_finished));
     c->message_send_status ().connect (
@@ -1102,9 +1374,19 @@ namespace Astroid {
 
     main_window->notebook.add_widget (&message_sending_status_icon);
 
-    c->send_threaded ();
+    /* the outbox keeps the message until it has been sent, even if
+     * this window is closed */
+    sending_message = astroid->outbox->send (std::move (c));
 
-    sending_message = std::move (c);
+    if (sending_message == NULL) {
+      main_window->notebook.remove_widget (&message_sending_status_icon);
+      status_icon_visible = false;
+      sending_in_progress.store (false);
+      fields_show ();
+
+      set_warning ("Cannot send, the message could not be written to the outbox.");
+      return false;
+    }
 
     return true;
   }
@@ -1145,6 +1427,12 @@ namespace Astroid {
     } else {
       fields_show ();
 
+      if (!sending_message->cancelled () &&
+          !astroid->config ().get<bool> ("astroid.debug.dryrun_sending")) {
+        set_info ("The message is kept in the outbox and will be sent again later.");
+        on_tv_ready ();
+      }
+
       pixbuf = theme->load_icon (
          "dialog-error",
           Notebook::icon_size,
@@ -1154,7 +1442,7 @@ namespace Astroid {
     message_sending_status_icon.set (pixbuf);
     sending_in_progress.store (false);
 
-    sending_message.reset();
+    sending_message = NULL;
 
     emit_message_sent_attempt (result_from_sender);
 
@@ -1185,7 +1473,7 @@ namespace Astroid {
     return c;
   }
 
-  void EditMessage::finalize_message (std::unique_ptr<ComposeMessage> &c) {
+  void EditMessage::finalize_message (std::unique_ptr<ComposeMessage> &c, bool defer_crypto) {
     /* these options are not known before setup_message is done, and the
      * new account information has been applied to the editor */
     if (c->account->has_signature && switch_signature->get_active ()) {
@@ -1200,8 +1488,13 @@ namespace Astroid {
       c->sign    = switch_sign->get_active ();
     }
 
+    c->defer_crypto = defer_crypto;
+    c->cache = &build_cache;
+
     c->build ();
     c->finalize ();
+
+    c->cache = NULL;
   }
 
   std::unique_ptr<ComposeMessage> EditMessage::make_message () {
@@ -1219,6 +1512,9 @@ namespace Astroid {
     if (draft) {
       /* Do not save signature in a draft */
       c->account->has_signature = false;
+
+      /* drafts are written by the draft worker */
+      c->private_parts = true;
     }
     finalize_message (c);
     c->account->has_signature = sigstate;
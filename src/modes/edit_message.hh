@@ -6,6 +6,7 @@
 # include <memory>
 # include <fstream>
 # include <mutex>
+# include <thread>
 
 # include <glibmm/iochannel.h>
 # include <boost/filesystem.hpp>
@@ -99,13 +100,13 @@ namespace Astroid {
       std::vector<ustring> attachment_words = { "attach" }; // defined in config
 
       bool send_message ();
-      void finalize_message (std::unique_ptr<ComposeMessage> &);
+      void finalize_message (std::unique_ptr<ComposeMessage> &, bool defer_crypto = false);
       std::unique_ptr<ComposeMessage> setup_message ();
       std::unique_ptr<ComposeMessage> make_message (bool draft);
       std::unique_ptr<ComposeMessage> make_message ();
       std::unique_ptr<ComposeMessage> make_draft_message ();
 
-      std::unique_ptr<ComposeMessage> sending_message;
+      ComposeMessage * sending_message = NULL; // owned by the outbox
       std::atomic<bool> sending_in_progress;
       void send_message_finished (bool result);
       void update_send_message_status (bool warn, ustring msg);
@@ -115,12 +116,20 @@ namespace Astroid {
 
       /* draft */
       bool save_draft_on_force_quit;
-      bool save_draft ();
+      bool save_draft ();  // build and queue the draft to be written
+      bool flush_draft (); // wait for queued drafts to be written
       void delete_draft ();
       static void delete_draft (refptr<Message> draft_msg);
       refptr<Message> draft_msg;
       bool draft_saved = false;
 
+      /* autosave the draft when returning from the editor */
+      bool autosave_draft;
+      int  autosave_draft_delay; // ms
+      sigc::connection c_autosave;
+      void queue_autosave ();
+      bool on_autosave ();
+
     protected:
       ptree editor_config;
 
@@ -138,6 +147,14 @@ namespace Astroid {
       void fields_hide ();       // hide fields
       void read_edited_message (); // load data from message after
                                    // it has been edited.
+
+      /* markdown and encryption results kept between builds of the
+       * message, the preview is only encrypted or signed on request */
+      ComposeMessage::BuildCache build_cache;
+      bool    preview_crypto = false;
+      ustring preview_input; // the message currently shown
+      ustring get_preview_input (ComposeMessage *);
+      refptr<Message> load_preview (ComposeMessage *);
       std::mutex message_draft_m;  // locks message draft
       std::atomic<bool> in_read;   // true if we are already in read
       void on_tv_ready ();
@@ -153,6 +170,29 @@ namespace Astroid {
       std::fstream tmpfile;
       void make_tmpfile ();
 
+      /* drafts are written to a temporary file and moved into place on
+       * a worker thread, only the latest of the queued drafts is written. */
+      struct DraftWrite {
+        std::unique_ptr<ComposeMessage> c;
+        ustring fname;
+        ustring hash;   // of the content of the draft
+        bool    success = false;
+        ustring error;
+      };
+
+      ustring draft_hash; // of the last written draft
+
+      std::mutex                  draft_m;
+      std::unique_ptr<DraftWrite> draft_queued;
+      std::vector<std::unique_ptr<DraftWrite>> draft_written;
+      std::thread                 draft_t;
+      bool                        draft_running = false;
+
+      void draft_worker ();
+      void write_draft (DraftWrite &);
+      Glib::Dispatcher d_draft_written;
+      void on_draft_written ();
+
       Gtk::Image message_sending_status_icon;
       bool status_icon_visible = false;
 
@@ -23,6 +23,7 @@ namespace Astroid {
     using std::string;
 
     msg = _msg;
+    msg->wait_for_crypto (); // the body is quoted below
 
     LOG (info) << "fwd: forwarding message " << msg->mid;
 
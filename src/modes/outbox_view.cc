@@ -0,0 +1,162 @@
+# include <ctime>
+
+# include "astroid.hh"
+# include "outbox_view.hh"
+# include "outbox.hh"
+# include "utils/date_utils.hh"
+
+namespace Astroid {
+  OutboxView::OutboxView (MainWindow * mw) : Mode (mw) {
+    set_label ("Outbox");
+
+    scroll.add (tv);
+    pack_start (scroll);
+
+    store = Gtk::ListStore::create (m_columns);
+    tv.set_model (store);
+
+    tv.append_column ("State", m_columns.m_col_state);
+    tv.append_column ("Account", m_columns.m_col_account);
+    tv.append_column ("To", m_columns.m_col_to);
+    tv.append_column ("Subject", m_columns.m_col_subject);
+    tv.append_column ("Attempts", m_columns.m_col_attempts);
+    tv.append_column ("Status", m_columns.m_col_status);
+
+    tv.set_sensitive (true);
+    set_sensitive (true);
+    set_can_focus (true);
+
+    show_all_children ();
+
+    reload ();
+
+    astroid->outbox->signal_changed ().connect (
+        sigc::mem_fun (this, &OutboxView::reload));
+
+    keys.title = "Outbox";
+    keys.register_key ("j", { Key (GDK_KEY_Down) },
+        "outbox.down",
+        "Move cursor down",
+        [&] (Key) {
+          Gtk::TreePath path;
+          Gtk::TreeViewColumn *c;
+          tv.get_cursor (path, c);
+
+          if (!path) return true;
+
+          path.next ();
+          Gtk::TreeIter it = store->get_iter (path);
+
+          if (it) {
+            tv.set_cursor (path);
+          }
+
+          return true;
+        });
+
+    keys.register_key ("k", { Key (GDK_KEY_Up) },
+        "outbox.up",
+        "Move cursor up",
+        [&] (Key) {
+          Gtk::TreePath path;
+          Gtk::TreeViewColumn *c;
+          tv.get_cursor (path, c);
+
+          if (!path) return true;
+
+          path.prev ();
+          if (path) {
+            tv.set_cursor (path);
+          }
+          return true;
+        });
+
+    keys.register_key ("r",
+        "outbox.retry",
+        "Send message again now",
+        [&] (Key) {
+          ustring id = get_current_id ();
+          if (!id.empty ()) astroid->outbox->retry (id);
+
+          return true;
+        });
+
+    keys.register_key ("d",
+        "outbox.delete",
+        "Delete message from outbox",
+        [&] (Key) {
+          ustring id = get_current_id ();
+
+          if (!id.empty ()) {
+            ask_yes_no ("Delete message from outbox? (it will not be sent)", [&, id] (bool yes) {
+                if (yes && !astroid->outbox->remove (id)) {
+                  LOG (warn) << "outbox: cannot delete message while it is being sent.";
+                }
+              });
+          }
+
+          return true;
+        });
+  }
+
+  void OutboxView::reload () {
+    ustring current = get_current_id ();
+
+    store->clear ();
+
+    for (auto &e : astroid->outbox->get_entries ()) {
+      auto row = *(store->append ());
+
+      row[m_columns.m_col_id]       = e.id;
+      row[m_columns.m_col_account]  = e.account;
+      row[m_columns.m_col_to]       = e.to;
+      row[m_columns.m_col_subject]  = e.subject;
+      row[m_columns.m_col_attempts] = e.attempts;
+
+      switch (e.state) {
+        case Outbox::Entry::Queued:
+          row[m_columns.m_col_state] = "queued";
+          if (e.next_try > 0) {
+            row[m_columns.m_col_status] = "retrying " + Date::pretty_print (e.next_try) + ": " + e.last_error;
+          }
+          break;
+
+        case Outbox::Entry::Sending:
+          row[m_columns.m_col_state] = "sending";
+          break;
+
+        case Outbox::Entry::Failed:
+          row[m_columns.m_col_state]  = "failed";
+          row[m_columns.m_col_status] = e.last_error;
+          break;
+      }
+
+      if (e.id == current) {
+        tv.set_cursor (store->get_path (row));
+      }
+    }
+  }
+
+  ustring OutboxView::get_current_id () {
+    Gtk::TreePath path;
+    Gtk::TreeViewColumn *c;
+    tv.get_cursor (path, c);
+
+    if (path) {
+      Gtk::TreeIter it = store->get_iter (path);
+      if (it) return (*it)[m_columns.m_col_id];
+    }
+
+    return "";
+  }
+
+  void OutboxView::grab_modal () {
+    add_modal_grab ();
+    grab_focus ();
+  }
+
+  void OutboxView::release_modal () {
+    remove_modal_grab ();
+  }
+}
+
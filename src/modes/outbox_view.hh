@@ -0,0 +1,52 @@
+# pragma once
+
+# include "proto.hh"
+# include "astroid.hh"
+# include "mode.hh"
+
+namespace Astroid {
+  /* shows the messages in the outbox and their send status */
+  class OutboxView : public Mode
+  {
+    public:
+      OutboxView (MainWindow *);
+
+      void grab_modal ()    override;
+      void release_modal () override;
+
+    protected:
+      class ModelColumns : public Gtk::TreeModel::ColumnRecord
+      {
+        public:
+
+          ModelColumns()
+          {
+            add (m_col_id);
+            add (m_col_state);
+            add (m_col_account);
+            add (m_col_to);
+            add (m_col_subject);
+            add (m_col_attempts);
+            add (m_col_status);
+          }
+
+          Gtk::TreeModelColumn<Glib::ustring> m_col_id;
+          Gtk::TreeModelColumn<Glib::ustring> m_col_state;
+          Gtk::TreeModelColumn<Glib::ustring> m_col_account;
+          Gtk::TreeModelColumn<Glib::ustring> m_col_to;
+          Gtk::TreeModelColumn<Glib::ustring> m_col_subject;
+          Gtk::TreeModelColumn<int>           m_col_attempts;
+          Gtk::TreeModelColumn<Glib::ustring> m_col_status;
+      };
+
+      ModelColumns m_columns;
+
+      Gtk::TreeView tv;
+      Gtk::ScrolledWindow scroll;
+      refptr<Gtk::ListStore> store;
+
+      void reload ();
+      ustring get_current_id ();
+  };
+}
+
@@ -19,6 +19,7 @@ namespace Astroid {
     : EditMessage (mw, false)
   {
     msg = _msg;
+    msg->wait_for_crypto (); // the body is quoted below
 
     LOG (info) << "re: reply to: " << msg->mid;
 
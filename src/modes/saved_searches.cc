@@ -4,6 +4,7 @@
 # include "main_window.hh"
 # include "thread_index/thread_index.hh"
 # include "db.hh"
+# include "poll.hh"
 
 # include <boost/property_tree/ptree.hpp>
 # include <boost/property_tree/json_parser.hpp>
@@ -514,6 +515,7 @@ namespace Astroid {
   }
 
   void SavedSearches::on_thread_changed (Db * db, ustring) {
+    PollListenerTimer t ("saved_searches");
     refresh_stats_db (db);
   }
 
@@ -1,5 +1,6 @@
 # include "astroid.hh"
 # include "db.hh"
+# include "poll.hh"
 
 # include "query_loader.hh"
 # include "thread_index.hh"
@@ -256,6 +257,8 @@ namespace Astroid {
   void QueryLoader::on_thread_changed (Db * db, ustring thread_id) {
     if (in_destructor) return;
 
+    PollListenerTimer t ("query_loader");
+
     LOG (info) << "ql (" << id << "): " << query << ", got changed thread signal: " << thread_id;
 
     if (loading ()) {
@@ -230,17 +230,17 @@ namespace Astroid {
 
     if (new_window) {
       MainWindow * nmw = astroid->open_new_window (false);
-      tv = Gtk::manage(new ThreadView (nmw));
+      tv = Gtk::manage(ThreadView::take_from_pool (nmw));
       nmw->add_mode (tv);
     } else if (new_tab) {
-      tv = Gtk::manage(new ThreadView (main_window));
+      tv = Gtk::manage(ThreadView::take_from_pool (main_window));
       main_window->add_mode (tv);
     } else {
       LOG (debug) << "ti: init paned tv";
       if (packed == 2) {
         tv = (ThreadView *) pw2;
       } else {
-        tv = new ThreadView (main_window);
+        tv = ThreadView::take_from_pool (main_window);
         add_pane (1, tv);
       }
     }
@@ -38,45 +38,67 @@ using namespace boost::filesystem;
 
 namespace Astroid {
   int PageClient::id = 0;
+  constexpr const char * PageClient::part_scheme;
+  constexpr const char * PageClient::part_css_uri;
 
   PageClient::PageClient (ThreadView * t) {
 
-    id++;
     ready = false;
+    run   = false;
     thread_view = t;
 
+    reader_cancel = Gio::Cancellable::create ();
+    d_acks.connect (sigc::mem_fun (this, &PageClient::process_acks));
+
     /* load attachment icon */
     Glib::RefPtr<Gtk::IconTheme> theme = Gtk::IconTheme::get_default();
     attachment_icon = theme->load_icon (
         "mail-attachment-symbolic",
         ATTACHMENT_ICON_WIDTH,
         Gtk::ICON_LOOKUP_USE_BUILTIN );
-
-    extension_connect_id = g_signal_connect (thread_view->context,
-        "initialize-web-extensions",
-        G_CALLBACK (PageClient_init_web_extensions),
-        (gpointer) this);
   }
 
   extern "C" void PageClient_init_web_extensions (
       WebKitWebContext * context,
-      gpointer           user_data) {
+      gpointer           /* user_data */) {
 
-    ((PageClient *) user_data)->init_web_extensions (context);
+    PageClient::init_web_extensions (context);
   }
 
   PageClient::~PageClient () {
     LOG (debug) << "pc: destruct";
-    g_signal_handler_disconnect (thread_view->context,
-        extension_connect_id);
 
     LOG (debug) << "pc: closing";
 
+    /* stop reader thread */
+    run = false;
+    reader_cancel->cancel ();
+    if (reader_t.joinable ()) reader_t.join ();
+
     istream.clear ();
     ostream.clear ();
 
-    ext->close ();
-    srv->close ();
+    if (ext) ext->close ();
+    if (srv) srv->close ();
+  }
+
+  void PageClient::init_web_context (WebKitWebContext * context) {
+    /* each page of the context listens on its own socket at this base
+     * address followed by the page id. the context may be shared by several
+     * thread views. */
+    ustring socket_base = ustring::compose ("%1/sockets/astroid.%2.%3.%4",
+        astroid->standard_paths ().runtime_dir.c_str(),
+        getpid(),
+        ++id,
+        UstringUtils::random_alphanumeric (30));
+
+    g_object_set_data_full (G_OBJECT (context), "astroid-socket-base",
+        g_strdup (socket_base.c_str ()), g_free);
+
+    g_signal_connect (context,
+        "initialize-web-extensions",
+        G_CALLBACK (PageClient_init_web_extensions),
+        NULL);
   }
 
   void PageClient::init_web_extensions (WebKitWebContext * context) {
@@ -113,14 +135,20 @@ namespace Astroid {
 
 # endif
 
-    /* set up unix socket */
-    LOG (warn) << "pc: id: " << id;
+    /* send base socket address (TODO: include key) */
+    const char * socket_base = (const char *) g_object_get_data (G_OBJECT (context), "astroid-socket-base");
+    GVariant * gaddr = g_variant_new_string (socket_base);
 
-    socket_addr = ustring::compose ("%1/sockets/astroid.%2.%3.%4",
-        astroid->standard_paths ().runtime_dir.c_str(),
-        getpid(),
-        id,
-        UstringUtils::random_alphanumeric (30));
+    webkit_web_context_set_web_extensions_initialization_user_data (
+        context,
+        gaddr);
+  }
+
+  void PageClient::listen (guint64 page_id) {
+    /* set up unix socket for the page */
+    const char * socket_base = (const char *) g_object_get_data (G_OBJECT (thread_view->context), "astroid-socket-base");
+
+    socket_addr = ustring::compose ("%1.%2", socket_base, page_id);
 
     refptr<Gio::UnixSocketAddress> addr = Gio::UnixSocketAddress::create (socket_addr,
         Gio::UNIX_SOCKET_ADDRESS_ABSTRACT);
@@ -138,13 +166,6 @@ namespace Astroid {
     /* listen */
     srv->accept_async (sigc::mem_fun (this, &PageClient::extension_connect));
     umask (p);
-
-    /* send socket address (TODO: include key) */
-    GVariant * gaddr = g_variant_new_string (addr->get_path ().c_str ());
-
-    webkit_web_context_set_web_extensions_initialization_user_data (
-        context,
-        gaddr);
   }
 
   void PageClient::extension_connect (refptr<Gio::AsyncResult> &res) {
@@ -155,6 +176,10 @@ namespace Astroid {
     istream = ext->get_input_stream ();
     ostream = ext->get_output_stream ();
 
+    /* start reading acks */
+    run = true;
+    reader_t = std::thread (&PageClient::reader, this);
+
     ready = true;
 
     if (thread_view->wk_loaded) {
@@ -163,6 +188,132 @@ namespace Astroid {
     }
   }
 
+  int PageClient::send_request (
+      AeProtocol::MessageTypes mt,
+      const ::google::protobuf::Message &m)
+  {
+    int rid = request_id + 1;
+
+    try {
+      AeProtocol::send_message_async (mt, m, ostream, m_ostream, rid);
+    } catch (AeProtocol::ipc_error &e) {
+      /* nothing was written (e.g. the message is too large), the request
+       * is dropped */
+      LOG (error) << "pc: could not send request: " << AeProtocol::MessageTypeStrings[mt] << ": " << e.what ();
+      return -1;
+    }
+
+    request_id = rid;
+    return rid;
+  }
+
+  AstroidMessages::Ack PageClient::send_request_sync (
+      AeProtocol::MessageTypes mt,
+      const ::google::protobuf::Message &m)
+  {
+    int rid = send_request (mt, m);
+
+    if (rid < 0) {
+      AstroidMessages::Ack a;
+      a.set_success (false);
+      return a;
+    }
+
+    return wait_for_ack (rid);
+  }
+
+  AstroidMessages::Ack PageClient::wait_for_ack (int rid) {
+    AstroidMessages::Ack a;
+    a.set_success (false);
+
+    LOG (debug) << "pc: waiting for ack: " << rid;
+
+    {
+      std::unique_lock<std::mutex> lk (m_acks);
+      acks_cv.wait (lk, [&] { return acked_id >= rid || !run; });
+    }
+
+    /* handle this and any outstanding acks in order */
+    for (auto &ack : take_acks ()) {
+      handle_ack (ack);
+
+      if (ack.id () == rid) a = ack;
+    }
+
+    if (a.id () != rid) {
+      LOG (error) << "pc: did not get ack for request: " << rid;
+    }
+
+    return a;
+  }
+
+  std::deque<AstroidMessages::Ack> PageClient::take_acks () {
+    std::deque<AstroidMessages::Ack> _acks;
+
+    std::lock_guard<std::mutex> lk (m_acks);
+    _acks.swap (acks);
+
+    return _acks;
+  }
+
+  void PageClient::process_acks () {
+    for (auto &ack : take_acks ()) {
+      handle_ack (ack);
+    }
+  }
+
+  void PageClient::reader () {
+    LOG (debug) << "pc: reader thread: started.";
+
+    /* re-used for every message */
+    std::vector<gchar> buffer;
+
+    while (run) {
+      AeProtocol::MessageTypes mt;
+
+      try {
+
+        mt = AeProtocol::read_message (
+            istream,
+            reader_cancel,
+            buffer);
+
+      } catch (AeProtocol::ipc_error &e) {
+        LOG (warn) << "pc: reader thread: " << e.what ();
+        break;
+      } catch (Gio::Error &e) {
+        LOG (warn) << "pc: reader thread: " << e.what ();
+        break;
+      }
+
+      if (mt != AeProtocol::MessageTypes::Ack) {
+        LOG (warn) << "pc: reader thread: unexpected message type: " << mt;
+        continue;
+      }
+
+      AstroidMessages::Ack a;
+      a.ParseFromArray (buffer.data(), buffer.size());
+
+      {
+        std::lock_guard<std::mutex> lk (m_acks);
+        acks.push_back (a);
+        acked_id = a.id ();
+      }
+
+      acks_cv.notify_all ();
+      d_acks.emit ();
+    }
+
+    /* wake up anyone waiting for an ack that will never arrive */
+    {
+      std::lock_guard<std::mutex> lk (m_acks);
+      run = false;
+    }
+    acks_cv.notify_all ();
+
+    LOG (debug) << "pc: reader thread: exit.";
+  }
+
   void PageClient::handle_ack (const AstroidMessages::Ack & ack) {
       LOG (debug) << "pc: got ack (s: " << ack.success () << ") , focus: " << ack.focus().mid () << ", e: " << ack.focus().element ();
 
@@ -187,7 +338,7 @@ namespace Astroid {
     LOG (debug) << "pc: sending page..";
     AstroidMessages::Page s;
     s.set_css  (thread_view->theme.thread_view_css.c_str ());
-    s.set_part_css (thread_view->theme.part_css.c_str ());
+    s.set_part_css_uri (part_css_uri);
     s.set_html (thread_view->theme.thread_view_html.c_str ());
 
     s.set_use_stdout (astroid->log_stdout);
@@ -197,6 +348,7 @@ namespace Astroid {
 
     /* send allowed URIs */
     s.add_allowed_uris (thread_view->home_uri);
+    s.add_allowed_uris (ustring (part_scheme) + "://");
 
     if (enable_gravatar) {
       s.add_allowed_uris ("https://www.gravatar.com/avatar/");
@@ -213,7 +365,7 @@ namespace Astroid {
     }
 # endif
 
-    AeProtocol::send_message_sync (AeProtocol::MessageTypes::Page, s, ostream, m_ostream, istream, m_istream);
+    send_request (AeProtocol::MessageTypes::Page, s);
   }
 
   void PageClient::allow_remote_resources () {
@@ -222,16 +374,14 @@ namespace Astroid {
     AstroidMessages::AllowRemoteImages msg;
     msg.set_bogus ("asdfadsf");
     msg.set_allow (true);
-    handle_ack (
-      AeProtocol::send_message_sync (AeProtocol::MessageTypes::AllowRemoteImages, msg, ostream, m_ostream, istream, m_istream)
-    );
+    send_request (AeProtocol::MessageTypes::AllowRemoteImages, msg);
   }
 
   void PageClient::clear_messages () {
     LOG (debug) << "pc: clear messages..";
     AstroidMessages::ClearMessage c;
     c.set_yes (true);
-    AeProtocol::send_message_sync (AeProtocol::MessageTypes::ClearMessages, c, ostream, m_ostream, istream, m_istream);
+    send_request (AeProtocol::MessageTypes::ClearMessages, c);
   }
 
   void PageClient::update_state () {
@@ -267,9 +417,7 @@ namespace Astroid {
       }
     }
 
-    handle_ack (
-      AeProtocol::send_message_sync (AeProtocol::MessageTypes::State, state, ostream, m_ostream, istream, m_istream)
-      );
+    send_request (AeProtocol::MessageTypes::State, state);
   }
 
   void PageClient::update_indent_state (bool indent) {
@@ -277,9 +425,7 @@ namespace Astroid {
     AstroidMessages::Indent msg;
     msg.set_bogus ("asdfadsf");
     msg.set_indent (indent);
-    handle_ack (
-      AeProtocol::send_message_sync (AeProtocol::MessageTypes::Indent, msg, ostream, m_ostream, istream, m_istream)
-    );
+    send_request (AeProtocol::MessageTypes::Indent, msg);
   }
 
   void PageClient::set_marked_state (refptr<Message> m, bool marked) {
@@ -287,9 +433,7 @@ namespace Astroid {
     msg.set_mid (m->safe_mid ());
     msg.set_marked (marked);
 
-    handle_ack (
-      AeProtocol::send_message_sync (AeProtocol::MessageTypes::Mark, msg, ostream, m_ostream, istream, m_istream)
-      );
+    send_request (AeProtocol::MessageTypes::Mark, msg);
   }
 
   void PageClient::set_hidden_state (refptr<Message> m, bool hidden) {
@@ -298,9 +442,7 @@ namespace Astroid {
     msg.set_mid (m->safe_mid ());
     msg.set_hidden (hidden);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Hidden, msg, ostream, m_ostream, istream, m_istream)
-        );
+    send_request (AeProtocol::MessageTypes::Hidden, msg);
   }
 
   void PageClient::set_focus (refptr<Message> m, unsigned int e) {
@@ -311,9 +453,7 @@ namespace Astroid {
       msg.set_focus (true);
       msg.set_element (e);
 
-      handle_ack (
-          AeProtocol::send_message_sync (AeProtocol::MessageTypes::Focus, msg, ostream, m_ostream, istream, m_istream)
-          );
+      send_request_sync (AeProtocol::MessageTypes::Focus, msg);
     } else {
       LOG (warn) << "pc: tried to focus unset message";
     }
@@ -348,15 +488,64 @@ namespace Astroid {
   void PageClient::remove_message (refptr<Message> m) {
     AstroidMessages::Message msg;
     msg.set_mid (m->safe_mid()); // just mid.
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::RemoveMessage, msg, ostream, m_ostream, istream, m_istream)
-        );
+    send_request (AeProtocol::MessageTypes::RemoveMessage, msg);
+  }
+
+  void PageClient::add_messages (std::vector<refptr<Message>> &ms) {
+    /* send the messages in as few requests as possible, but keep each batch
+     * well below the maximum message size. */
+    AstroidMessages::AddMessages msg;
+    size_t sz = 0;
+
+    for (auto &m : ms) {
+      AstroidMessages::Message * _m = msg.add_messages ();
+      *_m = make_message (m);
+      sz += _m->ByteSizeLong ();
+
+      if (sz > AeProtocol::MAX_MESSAGE_SZ / 4) {
+        send_add_messages (msg);
+        msg.Clear ();
+        sz = 0;
+      }
+    }
+
+    if (msg.messages_size () > 0) {
+      send_add_messages (msg);
+    }
+  }
+
+  void PageClient::send_add_messages (AstroidMessages::AddMessages & msg) {
+    if (send_request (AeProtocol::MessageTypes::AddMessages, msg) >= 0) return;
+
+    if (msg.messages_size () > 1) {
+      /* send the messages one by one, so that only the ones that cannot be
+       * sent are replaced */
+      for (auto &m : msg.messages ()) {
+        AstroidMessages::AddMessages one;
+        *one.add_messages () = m;
+        send_add_messages (one);
+      }
+
+    } else if (msg.messages_size () == 1) {
+      AstroidMessages::AddMessages one;
+      *one.add_messages () = make_error_stub (msg.messages (0));
+      send_request (AeProtocol::MessageTypes::AddMessages, one);
+    }
   }
 
-  void PageClient::add_message (refptr<Message> m) {
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::AddMessage, make_message (m), ostream, m_ostream, istream, m_istream)
-        );
+  AstroidMessages::Message PageClient::make_error_stub (const AstroidMessages::Message & m) {
+    /* only the headers of a message that could not be sent to the page,
+     * rendered like a message with missing content */
+    AstroidMessages::Message stub = m;
+
+    stub.clear_root ();
+    stub.clear_mime_messages ();
+    stub.clear_attachments ();
+
+    stub.set_missing_content (true);
+    stub.set_error ("This message could not be displayed, it is too large.");
+
+    return stub;
   }
 
   void PageClient::update_message (refptr<Message> m, AstroidMessages::UpdateMessage_Type t) {
@@ -365,9 +554,75 @@ namespace Astroid {
     *msg.mutable_m() = make_message (m, true);
     msg.set_type (t);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::UpdateMessage, msg, ostream, m_ostream, istream, m_istream)
-        );
+    send_update_message (msg);
+  }
+
+  void PageClient::send_update_message (AstroidMessages::UpdateMessage & msg) {
+    if (send_request (AeProtocol::MessageTypes::UpdateMessage, msg) < 0) {
+      *msg.mutable_m () = make_error_stub (msg.m ());
+      send_request (AeProtocol::MessageTypes::UpdateMessage, msg);
+    }
+  }
+
+  void PageClient::update_tags (refptr<Message> m) {
+    /* only the tags have changed, avoid re-building the whole message */
+    AstroidMessages::UpdateTags msg;
+    msg.set_mid (m->safe_mid ());
+    msg.set_tag_string (make_tag_string (m));
+
+    for (ustring &tag : m->tags) {
+      msg.add_tags (tag);
+    }
+
+    send_request (AeProtocol::MessageTypes::UpdateTags, msg);
+  }
+
+  ustring PageClient::make_tag_string (refptr<Message> m) {
+    unsigned char cv[] = { 0xff, 0xff, 0xff };
+
+    ustring tags_s;
+
+# ifndef DISABLE_PLUGINS
+    if (!thread_view->plugins->format_tags (m->tags, "#ffffff", false, tags_s)) {
+#  endif
+
+      tags_s = VectorUtils::concat_tags_color (m->tags, false, 0, cv);
+
+# ifndef DISABLE_PLUGINS
+    }
+# endif
+
+    return tags_s;
+  }
+
+  void PageClient::reload_message (refptr<Message> m) {
+    /* the MIME structure may have changed (e.g. after deferred decryption),
+     * rebuild the element state and re-render the message. */
+    typedef ThreadView::MessageState MessageState;
+    MessageState & s = thread_view->state[m];
+
+    int current_id = s.elements[s.current_element].id;
+    s.elements.erase (s.elements.begin () + 1, s.elements.end ());
+
+    AstroidMessages::UpdateMessage msg;
+    *msg.mutable_m() = make_message (m, false);
+    msg.set_type (AstroidMessages::UpdateMessage_Type_VisibleParts);
+
+    s.current_element = 0;
+    for (unsigned int i = 0; i < s.elements.size (); i++) {
+      if (s.elements[i].id == current_id) {
+        s.current_element = i;
+        break;
+      }
+    }
+
+    update_state ();
+
+    send_update_message (msg);
+
+    if (thread_view->focused_message == m) {
+      set_focus (m, s.current_element);
+    }
   }
 
   AstroidMessages::Message PageClient::make_message (refptr<Message> m, bool keep_state) {
@@ -413,21 +668,7 @@ namespace Astroid {
 
     /* tags */
     {
-      unsigned char cv[] = { 0xff, 0xff, 0xff };
-
-      ustring tags_s;
-
-# ifndef DISABLE_PLUGINS
-      if (!thread_view->plugins->format_tags (m->tags, "#ffffff", false, tags_s)) {
-#  endif
-
-        tags_s = VectorUtils::concat_tags_color (m->tags, false, 0, cv);
-
-# ifndef DISABLE_PLUGINS
-      }
-# endif
-
-      msg.set_tag_string (tags_s);
+      msg.set_tag_string (make_tag_string (m));
 
       for (ustring &tag : m->tags) {
         msg.add_tags (tag);
@@ -453,23 +694,24 @@ namespace Astroid {
       msg.set_gravatar (uri);
     }
 
-    /* set preview */
+    /* set preview: only decode as much of the body as can be shown */
     {
-      ustring bp = m->plain_text (false);
+      ustring bp = m->plain_text (false, MAX_PREVIEW_LEN + 1);
       if (static_cast<int>(bp.size()) > MAX_PREVIEW_LEN)
         bp = bp.substr(0, MAX_PREVIEW_LEN - 3) + "...";
 
-      while (true) {
-        size_t i = bp.find ("<br>");
-
-        if (i == ustring::npos) break;
-
-        bp.erase (i, 4);
-      }
+      bp = UstringUtils::erase (bp, "<br>");
 
       msg.set_preview (Glib::Markup::escape_text (bp));
     }
 
+    /* collapsed messages are only rendered with their header until they are
+     * expanded, this keeps long threads fast to lay out. */
+    msg.set_stub (thread_view->state[m].stub);
+    if (msg.stub ()) {
+      return msg;
+    }
+
     if (astroid->config().get<std::string> ("thread_view.preferred_type") == "plain" &&
         astroid->config().get<bool> ("thread_view.preferred_html_only")) {
       /* check if we have a preferred part - and open first viewable if not */
@@ -520,12 +762,10 @@ namespace Astroid {
       *_c = *_n;
       delete _n;
 
-      _c->set_thumbnail (get_attachment_thumbnail (c));
-
-      if (!c->content_id.empty ()) {
-        /* send content if CID is set */
-        _c->set_content (get_attachment_data (c));
-      }
+      /* content and thumbnail are fetched through the astroid-part:// scheme
+       * when they are shown */
+      _c->set_uri (part_uri (m, c));
+      _c->set_thumbnail (part_uri (m, c, true));
 
       if (!keep_state) {
         // add attachment to message state
@@ -584,7 +824,11 @@ namespace Astroid {
 
       vector<ustring> all_sig_errors;
 
-      if (c->issigned) {
+      /* the results are not available until the deferred operation is done,
+       * the message is reloaded when it finishes. */
+      part->set_crypto_pending (c->crypt->pending);
+
+      if (c->issigned && !c->crypt->pending) {
 
         refptr<Crypto> cr = c->crypt;
         part->mutable_signature()->set_verified (cr->verified);
@@ -697,7 +941,7 @@ namespace Astroid {
         }
       }
 
-      if (c->isencrypted) {
+      if (c->isencrypted && !c->crypt->pending) {
         refptr<Crypto> cr = c->crypt;
 
         if (cr->decrypted) {
@@ -822,9 +1066,7 @@ namespace Astroid {
     i.set_set (true);
     i.set_txt (txt);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Info, i, ostream, m_ostream, istream, m_istream)
-        );
+    send_request (AeProtocol::MessageTypes::Info, i);
   }
 
   void PageClient::hide_warning (refptr<Message> m) {
@@ -834,9 +1076,7 @@ namespace Astroid {
     i.set_set (false);
     i.set_txt ("");
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Info, i, ostream, m_ostream, istream, m_istream)
-        );
+    send_request (AeProtocol::MessageTypes::Info, i);
   }
 
   void PageClient::set_info (refptr<Message> m, ustring txt) {
@@ -846,9 +1086,7 @@ namespace Astroid {
     i.set_set (true);
     i.set_txt (txt);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Info, i, ostream, m_ostream, istream, m_istream)
-        );
+    send_request (AeProtocol::MessageTypes::Info, i);
   }
 
   void PageClient::hide_info (refptr<Message> m) {
@@ -858,13 +1096,106 @@ namespace Astroid {
     i.set_set (false);
     i.set_txt ("");
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Info, i, ostream, m_ostream, istream, m_istream)
-        );
+    send_request (AeProtocol::MessageTypes::Info, i);
+  }
+
+  ustring PageClient::part_uri (refptr<Message> m, refptr<Chunk> c, bool thumbnail) {
+    /* astroid-part://<mid>/<chunk id>[?thumbnail] */
+    return ustring::compose ("%1://%2/%3%4",
+        part_scheme,
+        Glib::uri_escape_string (m->safe_mid (), "", false),
+        c->id,
+        (thumbnail ? "?thumbnail" : ""));
   }
 
-  ustring PageClient::get_attachment_thumbnail (refptr<Chunk> c) { // {{{
-    /* set the preview image or icon on the attachment display element */
+  void PageClient::handle_part_request (WebKitURISchemeRequest * request) { // {{{
+    ustring uri (webkit_uri_scheme_request_get_uri (request));
+    LOG (debug) << "pc: part request: " << uri;
+
+    if (uri == part_css_uri) {
+      /* style sheet shared by all part iframes */
+      GBytes * css = g_bytes_new (thread_view->theme.part_css.data (), thread_view->theme.part_css.bytes ());
+      GInputStream * stream = g_memory_input_stream_new_from_bytes (css);
+
+      webkit_uri_scheme_request_finish (request, stream, g_bytes_get_size (css), "text/css");
+
+      g_object_unref (stream);
+      g_bytes_unref (css);
+      return;
+    }
+
+    refptr<Message> m;
+    refptr<Chunk>   c;
+    bool thumbnail = false;
+
+    ustring prefix = ustring (part_scheme) + "://";
+
+    if (uri.substr (0, prefix.size ()) == prefix) {
+      ustring p = uri.substr (prefix.size ());
+
+      std::size_t q = p.find ('?');
+      if (q != ustring::npos) {
+        thumbnail = (p.substr (q + 1) == "thumbnail");
+        p = p.substr (0, q);
+      }
+
+      std::size_t sl = p.rfind ('/');
+      if (sl != ustring::npos) {
+        ustring mid = Glib::uri_unescape_string (p.substr (0, sl));
+        int id = -1;
+
+        try {
+          id = std::stoi (p.substr (sl + 1));
+        } catch (std::exception &) { }
+
+        auto mi = std::find_if (
+            thread_view->mthread->messages.begin (),
+            thread_view->mthread->messages.end (),
+            [&] (auto &_m) { return _m->safe_mid () == mid; });
+
+        if (mi != thread_view->mthread->messages.end () && id >= 0) {
+          m = *mi;
+          if (!m->missing_content) c = m->get_chunk_by_id (id);
+        }
+      }
+    }
+
+    if (!c) {
+      LOG (warn) << "pc: part request: no such part: " << uri;
+      GError * err = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "no such part: %s", uri.c_str ());
+      webkit_uri_scheme_request_finish_error (request, err);
+      g_error_free (err);
+      return;
+    }
+
+    GBytes * data;
+    ustring  content_type;
+
+    if (thumbnail) {
+      data = get_attachment_thumbnail (c);
+      content_type = "image/png";
+    } else {
+      /* hand the decoded content over without copying it */
+      refptr<Glib::ByteArray> contents = c->contents ();
+      data = g_byte_array_free_to_bytes (g_byte_array_ref (contents->gobj ()));
+
+      if (c->content_type) {
+        content_type = ustring (g_mime_content_type_get_mime_type (c->content_type));
+      } else {
+        content_type = "application/octet-stream";
+      }
+    }
+
+    GInputStream * stream = g_memory_input_stream_new_from_bytes (data);
+
+    webkit_uri_scheme_request_finish (request, stream, g_bytes_get_size (data), content_type.c_str ());
+
+    g_object_unref (stream);
+    g_bytes_unref (data);
+  } // }}}
+
+  GBytes * PageClient::get_attachment_thumbnail (refptr<Chunk> c) { // {{{
+    /* create a png preview image or icon for the attachment */
     const char * _mtype = g_mime_content_type_get_media_type (c->content_type);
     ustring mime_type;
     if (_mtype == NULL) {
@@ -873,11 +1204,10 @@ namespace Astroid {
       mime_type = ustring(g_mime_content_type_get_mime_type (c->content_type));
     }
 
-    LOG (debug) << "tv: set attachment thumbnail, mime_type: " << mime_type << ", mtype: " << _mtype;
+    LOG (debug) << "tv: attachment thumbnail, mime_type: " << mime_type << ", mtype: " << _mtype;
 
     gchar * content;
     gsize   content_size;
-    ustring image_content_type;
 
     if ((_mtype != NULL) && (ustring(_mtype) == "image")) {
       auto mis = Gio::MemoryInputStream::create ();
@@ -891,37 +1221,18 @@ namespace Astroid {
         pb = pb->apply_embedded_orientation ();
 
         pb->save_to_buffer (content, content_size, "png");
-        image_content_type = "image/png";
       } catch (Gdk::PixbufError &ex) {
 
         LOG (error) << "tv: could not create icon from attachmed image.";
         attachment_icon->save_to_buffer (content, content_size, "png"); // default type is png
-        image_content_type = "image/png";
       }
     } else {
       // TODO: guess icon from mime type. Using standard icon for now.
 
       attachment_icon->save_to_buffer (content, content_size, "png"); // default type is png
-      image_content_type = "image/png";
-    }
-
-    return DomUtils::assemble_data_uri (image_content_type.c_str (), content, content_size);
-  } // }}}
-
-  ustring PageClient::get_attachment_data (refptr<Chunk> c) { // {{{
-    /* set the preview image or icon on the attachment display element */
-    const char * _mtype = g_mime_content_type_get_media_type (c->content_type);
-    ustring mime_type;
-    if (_mtype == NULL) {
-      mime_type = "application/octet-stream";
-    } else {
-      mime_type = ustring(g_mime_content_type_get_mime_type (c->content_type));
     }
 
-    auto data = c->contents ();
-
-    LOG (debug) << "tv: set attachment data, mime_type: " << mime_type << ", mtype: " << _mtype;
-    return DomUtils::assemble_data_uri (mime_type.c_str (), (const gchar *) data->get_data (), data->size ());
+    return g_bytes_new_take (content, content_size);
   } // }}}
 
   void PageClient::scroll_to_bottom () {
@@ -929,9 +1240,7 @@ namespace Astroid {
     n.set_direction (AstroidMessages::Navigate_Direction_Down);
     n.set_type (AstroidMessages::Navigate_Type_Extreme);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::scroll_to_top () {
@@ -939,9 +1248,7 @@ namespace Astroid {
     n.set_direction (AstroidMessages::Navigate_Direction_Up);
     n.set_type (AstroidMessages::Navigate_Type_Extreme);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::scroll_down_big () {
@@ -949,9 +1256,7 @@ namespace Astroid {
     n.set_direction (AstroidMessages::Navigate_Direction_Down);
     n.set_type (AstroidMessages::Navigate_Type_VisualBig);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::scroll_up_big () {
@@ -959,9 +1264,7 @@ namespace Astroid {
     n.set_direction (AstroidMessages::Navigate_Direction_Up);
     n.set_type (AstroidMessages::Navigate_Type_VisualBig);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::scroll_down_page () {
@@ -969,9 +1272,7 @@ namespace Astroid {
     n.set_direction (AstroidMessages::Navigate_Direction_Down);
     n.set_type (AstroidMessages::Navigate_Type_VisualPage);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::scroll_up_page () {
@@ -979,9 +1280,7 @@ namespace Astroid {
     n.set_direction (AstroidMessages::Navigate_Direction_Up);
     n.set_type (AstroidMessages::Navigate_Type_VisualPage);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::focus_next_element (bool force_change) {
@@ -995,9 +1294,7 @@ namespace Astroid {
       n.set_type (AstroidMessages::Navigate_Type_VisualElement);
     }
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::focus_previous_element (bool force_change) {
@@ -1011,9 +1308,7 @@ namespace Astroid {
       n.set_type (AstroidMessages::Navigate_Type_VisualElement);
     }
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::focus_next_message () {
@@ -1023,9 +1318,7 @@ namespace Astroid {
     n.set_type (AstroidMessages::Navigate_Type_Message);
     n.set_focus_top (false); // not relevant
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::focus_previous_message (bool focus_top) {
@@ -1035,9 +1328,7 @@ namespace Astroid {
     n.set_type (AstroidMessages::Navigate_Type_Message);
     n.set_focus_top (focus_top);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::focus_element (refptr<Message> m, unsigned int e) {
@@ -1048,9 +1339,7 @@ namespace Astroid {
     n.set_mid (m->safe_mid ());
     n.set_element (e);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
   }
 
   void PageClient::update_focus_to_view () {
@@ -1059,9 +1348,18 @@ namespace Astroid {
     n.set_direction (AstroidMessages::Navigate_Direction_Specific);
     n.set_type (AstroidMessages::Navigate_Type_FocusView);
 
-    handle_ack (
-        AeProtocol::send_message_sync (AeProtocol::MessageTypes::Navigate, n, ostream, m_ostream, istream, m_istream)
-        );
+    send_request_sync (AeProtocol::MessageTypes::Navigate, n);
+  }
+
+  void PageClient::select_search_match (refptr<Message> m, int chunk_id, ustring text, int index) {
+    AstroidMessages::SearchMatch msg;
+
+    msg.set_mid (m->safe_mid ());
+    msg.set_sid (ustring::compose ("%1", chunk_id));
+    msg.set_text (text);
+    msg.set_index (index);
+
+    send_request (AeProtocol::MessageTypes::SearchMatch, msg);
   }
 }
 
@@ -7,11 +7,15 @@
 # include <gtkmm.h>
 # include <thread>
 # include <atomic>
+# include <mutex>
+# include <condition_variable>
+# include <deque>
 
 # include "astroid.hh"
 # include "thread_view.hh"
 
 # include "messages.pb.h"
+# include "modes/thread_view/webextension/ae_protocol.hh"
 
 namespace Astroid {
   extern "C" void PageClient_init_web_extensions (
@@ -25,12 +29,19 @@ namespace Astroid {
 
       ThreadView * thread_view;
 
-      void init_web_extensions (WebKitWebContext * context);
+      /* set up a web context for thread views, may be shared by several */
+      static void init_web_context (WebKitWebContext * context);
+      static void init_web_extensions (WebKitWebContext * context);
+
+      /* listen for the extension of the page */
+      void listen (guint64 page_id);
 
       /* ThreadView interface */
       void load ();
-      void add_message (refptr<Message> m);
+      void add_messages (std::vector<refptr<Message>> &ms);
       void update_message (refptr<Message> m, AstroidMessages::UpdateMessage_Type t);
+      void update_tags (refptr<Message> m);
+      void reload_message (refptr<Message> m);
       void remove_message (refptr<Message> m);
       void update_state ();
       void clear_messages ();
@@ -65,16 +76,26 @@ namespace Astroid {
       void focus_previous_message (bool focus_top);
       void update_focus_to_view ();
 
+      /* select a search match: the index'th occurrence of text in a part */
+      void select_search_match (refptr<Message> m, int chunk_id, ustring text, int index);
+
       bool enable_gravatar = false;
 
+      /* attachment and inline part content is served on request through
+       * this uri scheme, registered on the web context of the thread view */
+      static constexpr const char * part_scheme = "astroid-part";
+      static constexpr const char * part_css_uri = "astroid-part://theme/part.css";
+      void handle_part_request (WebKitURISchemeRequest * request);
+
       std::atomic<bool> ready;
 
     private:
       AstroidMessages::Message  make_message (refptr<Message> m, bool keep_state = false);
+      ustring make_tag_string (refptr<Message> m);
       AstroidMessages::Message::Chunk * build_mime_tree (refptr<Message> m, refptr<Chunk> c, bool root, bool shallow, bool keep_state = false);
 
-      ustring get_attachment_thumbnail (refptr<Chunk>);
-      ustring get_attachment_data (refptr<Chunk>);
+      ustring part_uri (refptr<Message> m, refptr<Chunk> c, bool thumbnail = false);
+      GBytes * get_attachment_thumbnail (refptr<Chunk>);
 
       static const int MAX_PREVIEW_LEN = 80;
       static const int THUMBNAIL_WIDTH        = 150; // px
@@ -89,12 +110,38 @@ namespace Astroid {
       refptr<Gio::SocketListener> srv;
       refptr<Gio::UnixConnection> ext;
       void extension_connect (refptr<Gio::AsyncResult> &res);
-      gulong extension_connect_id;
 
       refptr<Gio::InputStream>  istream;
       refptr<Gio::OutputStream> ostream;
       std::mutex      m_ostream;
-      std::mutex      m_istream;
+
+      /* requests are pipelined: send_request returns as soon as the message
+       * is written, the acks are read on the reader thread and handled in
+       * order on the GUI thread. send_request_sync blocks until the ack of
+       * the request (and all before it) has been received. */
+      int  send_request (AeProtocol::MessageTypes mt, const ::google::protobuf::Message &m);
+      AstroidMessages::Ack send_request_sync (AeProtocol::MessageTypes mt, const ::google::protobuf::Message &m);
+      AstroidMessages::Ack wait_for_ack (int id);
+
+      /* messages that cannot be sent (e.g. because they exceed the maximum
+       * message size) are replaced by a stub with only their headers */
+      void send_add_messages (AstroidMessages::AddMessages &);
+      void send_update_message (AstroidMessages::UpdateMessage &);
+      AstroidMessages::Message make_error_stub (const AstroidMessages::Message &);
+
+      int             request_id = 0; // last request sent
+      int             acked_id   = 0; // last request acknowledged (m_acks)
+      std::mutex      m_acks;
+      std::condition_variable acks_cv;
+      std::deque<AstroidMessages::Ack> acks;
+      Glib::Dispatcher d_acks;
+      void        process_acks ();
+      std::deque<AstroidMessages::Ack> take_acks ();
+
+      std::thread reader_t;
+      void        reader ();
+      std::atomic<bool> run;
+      refptr<Gio::Cancellable> reader_cancel;
 
       void        handle_ack (const AstroidMessages::Ack & ack);
   };
@@ -3,11 +3,13 @@
 # include <atomic>
 # include <iostream>
 # include <fstream>
+# include <vector>
 # include <boost/filesystem.hpp>
 
 # include "astroid.hh"
 # include "config.hh"
 # include "utils/resource.hh"
+# include "utils/ustring_utils.hh"
 
 # ifndef DISABLE_LIBSASS
 
@@ -125,6 +127,66 @@ namespace Astroid {
      */
     using std::endl;
 
+    /* the compiled style sheet is cached, keyed by the scss source, the
+     * files it imports and the libsass version. the imported files are
+     * only known after compiling, they are listed in a .deps file keyed
+     * by the source alone. */
+    ustring source_key;
+    {
+      std::ifstream f (scsspath);
+      std::string scss ((std::istreambuf_iterator<char> (f)), std::istreambuf_iterator<char> ());
+
+      Glib::Checksum chk (Glib::Checksum::ChecksumType::CHECKSUM_SHA256);
+      chk.update (scsspath);
+      chk.update (scss);
+      chk.update (libsass_version ());
+
+      source_key = chk.get_string ();
+    }
+
+    path cache_dir = astroid->standard_paths ().cache_dir / path ("css");
+    path deps_file = cache_dir / path (source_key + ".deps");
+
+    auto cached_path = [&] (std::vector<std::string> & deps) {
+      Glib::Checksum chk (Glib::Checksum::ChecksumType::CHECKSUM_SHA256);
+      chk.update (source_key);
+
+      for (auto &d : deps) {
+        std::ifstream f (d);
+        std::string c ((std::istreambuf_iterator<char> (f)), std::istreambuf_iterator<char> ());
+
+        chk.update ("\n" + d + "\n");
+        chk.update (c);
+      }
+
+      return cache_dir / path (chk.get_string () + ".css");
+    };
+
+    if (is_regular_file (deps_file)) {
+      std::vector<std::string> deps;
+      {
+        std::ifstream f (deps_file.c_str ());
+        std::string d;
+        while (std::getline (f, d)) {
+          if (!d.empty ()) deps.push_back (d);
+        }
+      }
+
+      path cached = cached_path (deps);
+
+      if (is_regular_file (cached)) {
+        LOG (info) << "theme: using compiled: " << cached.c_str () << " (" << scsspath << ")";
+
+        std::ifstream f (cached.c_str ());
+        std::istreambuf_iterator<char> eos; // default is eos
+        std::istreambuf_iterator<char> iit (f);
+
+        ustring css;
+        css.append (iit, eos);
+        return css;
+      }
+    }
+
     LOG (info) << "theme: processing: " << scsspath;
 
     struct Sass_File_Context* file_ctx = sass_make_file_context(scsspath);
@@ -146,8 +208,44 @@ namespace Astroid {
 
     const char * output = sass_context_get_output_string(context);
     ustring output_str(output);
+
+    /* the first included file is the source itself */
+    std::vector<std::string> deps;
+    char ** included = sass_context_get_included_files (context);
+    for (size_t i = 1; included && included[i]; i++) {
+      deps.push_back (included[i]);
+    }
+
     sass_delete_file_context (file_ctx);
 
+    /* store compiled style sheet, and then the files it depends on */
+    path cached = cached_path (deps);
+    std::string rnd = UstringUtils::random_alphanumeric (8);
+    path tmp      = cache_dir / path ((cached.filename ().string () + "." + rnd + ".tmp").c_str ());
+    path deps_tmp = cache_dir / path ((deps_file.filename ().string () + "." + rnd + ".tmp").c_str ());
+
+    try {
+      bfs::create_directories (cache_dir);
+
+      std::ofstream f (tmp.c_str ());
+      f << output_str;
+      f.close ();
+
+      bfs::rename (tmp, cached);
+
+      std::ofstream df (deps_tmp.c_str ());
+      for (auto &d : deps) df << d << std::endl;
+      df.close ();
+
+      bfs::rename (deps_tmp, deps_file);
+
+    } catch (const std::exception &ex) {
+      LOG (warn) << "theme: could not store compiled style sheet: " << ex.what ();
+      boost::system::error_code ec;
+      bfs::remove (tmp, ec);
+      bfs::remove (deps_tmp, ec);
+    }
+
     return output_str;
   }
 # endif
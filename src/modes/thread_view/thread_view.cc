@@ -62,28 +62,35 @@ namespace Astroid {
         UstringUtils::random_alphanumeric (120));
 
     /* WebKit: set up webkit web view */
+    const ptree& config = astroid->config ("thread_view");
+
+    /* create web context, optionally shared by all thread views */
+    if (config.get<bool> ("shared_process")) {
+      if (shared_context == NULL) {
+        shared_context = make_web_context (true);
+      }
 
-    /* create web context */
-    context = webkit_web_context_new_ephemeral ();
+      context = shared_context;
+    } else {
+      context = make_web_context (false);
+    }
 
     /* set up this extension interface */
     page_client = new PageClient (this);
 
-    const ptree& config = astroid->config ("thread_view");
+    search_cancel = false;
+    d_search_done.connect (sigc::mem_fun (this, &ThreadView::on_search_done));
+
     indent_messages = config.get<bool> ("indent_messages");
     open_html_part_external = config.get<bool> ("open_html_part_external");
     open_external_link = config.get<string> ("open_external_link");
 
     expand_flagged = config.get<bool> ("expand_flagged");
+    lazy_render = config.get<bool> ("lazy_render");
 
     page_client->enable_gravatar = config.get<bool>("gravatar.enable");
     unread_delay = config.get<double>("mark_unread_delay");
 
-    /* one process for each webview so that a new and unique
-     * instance of the webextension is created for each webview
-     * and page */
-    webkit_web_context_set_process_model (context, WEBKIT_PROCESS_MODEL_MULTIPLE_SECONDARY_PROCESSES);
-
     websettings = WEBKIT_SETTINGS (webkit_settings_new_with_settings (
         "enable-javascript", FALSE,
         "enable-java", FALSE,
@@ -114,6 +121,12 @@ namespace Astroid {
 
     gtk_box_pack_start (GTK_BOX (this->gobj ()), GTK_WIDGET (webview), true, true, 0);
 
+    /* used to find the thread view of requests on a shared context */
+    g_object_set_data (G_OBJECT (webview), "astroid-thread-view", this);
+
+    /* the extension instance of this page connects to its own socket */
+    page_client->listen (webkit_web_view_get_page_id (webview));
+
     g_signal_connect (webview, "load-changed",
         G_CALLBACK(ThreadView_on_load_changed),
         (gpointer) this );
@@ -139,8 +152,87 @@ namespace Astroid {
 
   }
 
+  WebKitWebContext * ThreadView::shared_context = NULL;
+
+  WebKitWebContext * ThreadView::make_web_context (bool shared) {
+    WebKitWebContext * c = webkit_web_context_new_ephemeral ();
+
+    if (shared) {
+      /* all thread views are pages in the same web process, with an
+       * instance of the webextension for each page */
+      webkit_web_context_set_process_model (c, WEBKIT_PROCESS_MODEL_SHARED_SECONDARY_PROCESS);
+    } else {
+      /* one process for each webview so that a new and unique
+       * instance of the webextension is created for each webview
+       * and page */
+      webkit_web_context_set_process_model (c, WEBKIT_PROCESS_MODEL_MULTIPLE_SECONDARY_PROCESSES);
+    }
+
+    /* attachments and inline parts are loaded on demand */
+    webkit_web_context_register_uri_scheme (c, PageClient::part_scheme,
+        ThreadView_on_part_request, NULL, NULL);
+
+    PageClient::init_web_context (c);
+
+    return c;
+  }
+
+  std::vector<ThreadView *> ThreadView::pool;
+  sigc::connection ThreadView::pool_refill;
+
+  ThreadView * ThreadView::take_from_pool (MainWindow * mw) {
+    ThreadView * tv;
+
+    if (pool.empty ()) {
+      LOG (debug) << "tv: pool empty, creating new thread view.";
+      tv = new ThreadView (mw);
+    } else {
+      LOG (debug) << "tv: using pre-initialized thread view.";
+      tv = pool.back ();
+      pool.pop_back ();
+      tv->set_main_window (mw);
+    }
+
+    fill_pool ();
+
+    return tv;
+  }
+
+  void ThreadView::fill_pool () {
+    unsigned int size = astroid->config ("thread_view").get<unsigned int> ("preload_pool");
+
+    if (pool.size () < size && !pool_refill.connected ()) {
+      pool_refill = Glib::signal_idle ().connect (
+          sigc::ptr_fun (&ThreadView::refill_pool), Glib::PRIORITY_LOW);
+    }
+  }
+
+  bool ThreadView::refill_pool () {
+    unsigned int size = astroid->config ("thread_view").get<unsigned int> ("preload_pool");
+
+    /* create one view per idle iteration so that we do not block the ui */
+    if (pool.size () < size) {
+      LOG (debug) << "tv: pre-initializing thread view (" << (pool.size () + 1) << "/" << size << ")";
+      pool.push_back (new ThreadView (NULL));
+    }
+
+    return pool.size () < size;
+  }
+
+  void ThreadView::clear_pool () {
+    pool_refill.disconnect ();
+
+    for (ThreadView * tv : pool) {
+      tv->pre_close ();
+      delete tv;
+    }
+
+    pool.clear ();
+  }
+
   ThreadView::~ThreadView () { //
     LOG (debug) << "tv: deconstruct.";
+    cancel_search ();
     g_object_unref (websettings);
   }
 
@@ -151,6 +243,24 @@ namespace Astroid {
 # endif
 
     delete page_client;
+    page_client = NULL;
+  }
+
+  extern "C" void ThreadView_on_part_request (
+      WebKitURISchemeRequest * request,
+      gpointer /* user_data */) {
+
+    ThreadView * tv = (ThreadView *) g_object_get_data (
+        G_OBJECT (webkit_uri_scheme_request_get_web_view (request)),
+        "astroid-thread-view");
+
+    if (tv && tv->page_client) {
+      tv->page_client->handle_part_request (request);
+    } else {
+      GError * err = g_error_new (G_IO_ERROR, G_IO_ERROR_CLOSED, "thread view closed");
+      webkit_uri_scheme_request_finish_error (request, err);
+      g_error_free (err);
+    }
   }
 
   /* navigation requests  */
@@ -324,8 +434,9 @@ namespace Astroid {
 
     Db db (Db::DbMode::DATABASE_READ_ONLY);
 
+    /* decryption and verification is finished after the messages are shown */
     auto _mthread = refptr<MessageThread>(new MessageThread (thread));
-    _mthread->load_messages (&db);
+    _mthread->load_messages (&db, true);
 
     if (unread_setup) unread_checker.disconnect ();
     unread_setup = false; // reset
@@ -336,6 +447,9 @@ namespace Astroid {
   void ThreadView::load_message_thread (refptr<MessageThread> _mthread) {
     ready = false;
 
+    /* matches refer to the messages of the previous thread */
+    reset_search ();
+
     mthread.clear ();
     mthread = _mthread;
 
@@ -362,7 +476,7 @@ namespace Astroid {
           refptr<Message> _m = refptr<Message> (m);
           _m->reference (); // since m is owned by caller
 
-          page_client->update_message (_m, AstroidMessages::UpdateMessage_Type_Tags);
+          page_client->update_tags (_m);
           page_client->update_state ();
         }
 
@@ -390,6 +504,17 @@ namespace Astroid {
 
         page_client->remove_message (_m);
         page_client->update_state ();
+
+      } else if (me ==
+          Message::MessageChangedEvent::MESSAGE_CRYPTO_DONE)
+      {
+        refptr<Message> _m = refptr<Message> (m);
+        _m->reference (); // since m is owned by caller
+
+        if (state.count (_m)) {
+          LOG (debug) << "tv: crypto done for message: " << m->mid;
+          page_client->reload_message (_m);
+        }
       }
     }
   }
@@ -426,9 +551,7 @@ namespace Astroid {
     focused_message.clear ();
 
     if (mthread) {
-      for (auto &m : mthread->messages) {
-        add_message (m);
-      }
+      add_messages (mthread->messages);
 
       page_client->update_state ();
       update_all_indent_states ();
@@ -479,19 +602,35 @@ namespace Astroid {
     page_client->update_indent_state (indent_messages);
   }
 
-  void ThreadView::add_message (refptr<Message> m) {
-    LOG (debug) << "tv: adding message: " << m->mid;
+  void ThreadView::add_messages (std::vector<refptr<Message>> &ms) {
+    LOG (debug) << "tv: adding messages: " << ms.size ();
+
+    for (auto &m : ms) {
+      state.insert (std::pair<refptr<Message>, MessageState> (m, MessageState ()));
 
-    state.insert (std::pair<refptr<Message>, MessageState> (m, MessageState ()));
+      /* messages that start out collapsed are rendered as header-only stubs */
+      state[m].stub = lazy_render && !expand_by_default (m);
 
-    m->signal_message_changed ().connect (
-        sigc::mem_fun (this, &ThreadView::on_message_changed));
+      m->signal_message_changed ().connect (
+          sigc::mem_fun (this, &ThreadView::on_message_changed));
+    }
+
+    /* the extension builds and inserts the whole batch at once */
+    page_client->add_messages (ms);
+
+    for (auto &m : ms) {
+      setup_message (m);
+    }
+  }
 
-    page_client->add_message (m);
+  bool ThreadView::expand_by_default (refptr<Message> m) {
+    return edit_mode || m->has_tag ("unread") || (expand_flagged && m->has_tag ("flagged"));
+  }
 
+  void ThreadView::setup_message (refptr<Message> m) {
     if (!edit_mode) {
       /* optionally hide / collapse the message */
-      if (!(m->has_tag("unread") || (expand_flagged && m->has_tag("flagged")))) {
+      if (!expand_by_default (m)) {
 
         collapse (m);
       } else {
@@ -557,7 +696,7 @@ namespace Astroid {
 
     Db db (Db::DbMode::DATABASE_READ_ONLY);
     auto _mthread = refptr<MessageThread>(new MessageThread (thread));
-    _mthread->load_messages (&db);
+    _mthread->load_messages (&db, true);
     load_message_thread (_mthread);
   }
 
@@ -1933,6 +2072,12 @@ namespace Astroid {
     /* returns true if the message was expanded in the first place */
     bool wasexpanded  = state[m].expanded;
 
+    if (state[m].stub) {
+      /* render the body of a message that was collapsed when loaded */
+      state[m].stub = false;
+      page_client->reload_message (m);
+    }
+
     state[m].expanded = true;
     page_client->set_hidden_state (m, false);
 
@@ -2132,8 +2277,10 @@ namespace Astroid {
   }
 
   void ThreadView::reset_search () {
+    cancel_search ();
+
     /* reset */
-    if (in_search) {
+    if (in_search && mthread) {
       /* reset search expanded state */
       for (auto m : mthread->messages) {
         state[m].search_expanded = false;
@@ -2142,50 +2289,297 @@ namespace Astroid {
 
     in_search = false;
     search_q  = "";
+    search_hits.clear ();
+    search_hit = -1;
 
     WebKitFindController * f = webkit_web_view_get_find_controller (webview);
     webkit_find_controller_search_finish (f);
   }
 
+  void ThreadView::cancel_search () {
+    if (search_t.joinable ()) {
+      search_cancel = true;
+      search_t.join ();
+    }
+
+    search_results.clear ();
+  }
+
   void ThreadView::on_search (ustring k) {
-    if (!k.empty ()) {
+    if (!k.empty () && mthread) {
+      cancel_search ();
 
-      /* expand all messages, these should be closed - except the focused one
-       * when a search is cancelled */
-      for (auto m : mthread->messages) {
-        state[m].search_expanded = !expand (m);
+      LOG (debug) << "tv: searching for: " << k;
+      search_q  = k;
+      in_search = true;
+
+      std::vector<SearchText> texts;
+      for (auto &m : mthread->messages) {
+        if (m->root) search_texts (texts, m, m->root);
       }
 
-      LOG (debug) << "tv: searching for: " << k;
-      WebKitFindController * f = webkit_web_view_get_find_controller (webview);
+      search_cancel = false;
+      search_t = std::thread (&ThreadView::search_worker, this, k, std::move (texts));
+    }
+  }
 
-      webkit_find_controller_search (f, k.c_str (),
-          WEBKIT_FIND_OPTIONS_CASE_INSENSITIVE |
-          WEBKIT_FIND_OPTIONS_WRAP_AROUND,
-          0);
-      in_search = true;
-      page_client->update_focus_to_view ();
+  void ThreadView::search_texts (
+      std::vector<SearchText> & texts,
+      refptr<Message> m,
+      refptr<Chunk> c)
+  {
+    /* only copy the encoded content here, decoding is done by the worker */
+    bool pending = c->isencrypted && (c->crypt->pending || !c->crypt->decrypted);
+
+    if (c->viewable && !c->attachment && !pending &&
+        c->mime_object != NULL && GMIME_IS_PART (c->mime_object) &&
+        (c->is_content_type ("text", "plain") || c->is_content_type ("text", "html")))
+    {
+      GMimeDataWrapper * content = g_mime_part_get_content ((GMimePart *) c->mime_object);
+      GMimeStream * stream = g_mime_data_wrapper_get_stream (content);
+
+      GMimeStream * copy = g_mime_stream_mem_new ();
+      g_mime_stream_reset (stream);
+      g_mime_stream_write_to_stream (stream, copy);
+      g_mime_stream_reset (stream);
+      g_mime_stream_reset (copy);
+
+      const char * charset = g_mime_object_get_content_type_parameter (
+          GMIME_OBJECT (c->mime_object), "charset");
+
+      texts.push_back ({
+          m,
+          c->id,
+          copy,
+          g_mime_data_wrapper_get_encoding (content),
+          charset ? charset : "",
+          c->is_content_type ("text", "html") });
+    }
+
+    for (auto &k : c->kids) {
+      search_texts (texts, m, k);
     }
   }
 
-  void ThreadView::next_search_match () {
-    if (!in_search) return;
-    /* there does not seem to be a way to figure out which message currently
-     * contains the selected matched text, but when there is a scroll event
-     * the match is centered.
-     */
+  ustring ThreadView::search_decode (SearchText & s) {
+    GMimeStream * filter_stream = g_mime_stream_filter_new (s.content);
+
+    GMimeFilter * filter = g_mime_filter_basic_new (s.encoding, false);
+    g_mime_stream_filter_add (GMIME_STREAM_FILTER (filter_stream), filter);
+    g_object_unref (filter);
+
+    if (!s.charset.empty ()) {
+      ustring charset = s.charset;
+      if (charset == "utf-8") charset = "UTF-8";
+
+      filter = g_mime_filter_charset_new (charset.c_str (), "UTF-8");
+      g_mime_stream_filter_add (GMIME_STREAM_FILTER (filter_stream), filter);
+      g_object_unref (filter);
+    }
+
+    filter = g_mime_filter_dos2unix_new (false);
+    g_mime_stream_filter_add (GMIME_STREAM_FILTER (filter_stream), filter);
+    g_object_unref (filter);
+
+    std::string str;
+    char buffer[4096];
+    ssize_t n;
+
+    while ((n = g_mime_stream_read (filter_stream, buffer, sizeof (buffer))) > 0) {
+      str.append (buffer, n);
+    }
+
+    g_object_unref (filter_stream);
+
+    ustring text (str);
+    if (!text.validate ()) return "";
+
+    if (s.html) text = html_to_text (text);
 
+    /* spaces may be rendered as non-breaking spaces */
+    return UstringUtils::replace (text, "\u00a0", " ");
+  }
+
+  ustring ThreadView::html_to_text (ustring _html) {
+    /* approximation of the text content of the rendered part: tags,
+     * comments, scripts and style sheets are removed and entities are
+     * decoded. markup is ascii, so the utf-8 is scanned bytewise. */
+    std::string html  = _html;
+    std::string text;
+
+    /* only the markup is matched against the lower-cased copy, so keep
+     * the byte offsets the same */
+    gchar * l = g_ascii_strdown (html.c_str (), html.size ());
+    std::string lower (l);
+    g_free (l);
+
+    std::string::size_type i = 0;
+
+    while (i < html.size ()) {
+      char c = html[i];
+
+      if (c == '<') {
+        if (html.compare (i, 4, "<!--") == 0) {
+          auto e = html.find ("-->", i + 4);
+          i = (e == std::string::npos) ? html.size () : e + 3;
+          continue;
+        }
+
+        auto e = html.find ('>', i);
+        if (e == std::string::npos) break;
+
+        std::string tag = lower.substr (i + 1, e - i - 1);
+        i = e + 1;
+
+        /* skip the content of elements that are not displayed */
+        for (std::string t : { "script", "style", "title" }) {
+          if (tag.compare (0, t.size (), t) == 0 &&
+              (tag.size () == t.size () || g_ascii_isspace (tag[t.size ()]))) {
+            auto end = lower.find ("</" + t, i);
+            i = (end == std::string::npos) ? html.size () : end;
+            break;
+          }
+        }
+
+        continue;
+      }
+
+      if (c == '&') {
+        auto e = html.find (';', i);
+
+        if (e != std::string::npos && e - i <= 10) {
+          std::string ent = html.substr (i + 1, e - i - 1);
+          gunichar r = 0;
+
+          if (ent == "amp")       r = '&';
+          else if (ent == "lt")   r = '<';
+          else if (ent == "gt")   r = '>';
+          else if (ent == "quot") r = '"';
+          else if (ent == "apos") r = '\'';
+          else if (ent == "nbsp") r = ' ';
+          else if (ent.size () > 1 && ent[0] == '#') {
+            r = (ent[1] == 'x' || ent[1] == 'X') ?
+              g_ascii_strtoull (ent.c_str () + 2, NULL, 16) :
+              g_ascii_strtoull (ent.c_str () + 1, NULL, 10);
+
+            if (!g_unichar_validate (r)) r = 0;
+          }
+
+          if (r) {
+            char buf[6];
+            text.append (buf, g_unichar_to_utf8 (r, buf));
+            i = e + 1;
+            continue;
+          }
+        }
+      }
+
+      text += c;
+      i++;
+    }
+
+    return text;
+  }
+
+  void ThreadView::search_worker (ustring k, std::vector<SearchText> texts) {
+    /* runs on the search thread: decode and search the text of the
+     * parts, without requiring the messages to be rendered. */
+    std::vector<SearchHit> hits;
+    ustring q = UstringUtils::replace (k, "\u00a0", " ").lowercase ();
+
+    for (auto &s : texts) {
+      if (search_cancel) break;
+
+      ustring t = search_decode (s).lowercase ();
+
+      int index = 0;
+      for (ustring_sz o = t.find (q); o != ustring::npos; o = t.find (q, o + q.size ())) {
+        hits.push_back ({ s.message, s.chunk_id, o, index++ });
+      }
+    }
+
+    for (auto &s : texts) {
+      g_object_unref (s.content);
+    }
+
+    if (search_cancel) return;
+
+    search_results = hits;
+    d_search_done.emit ();
+  }
+
+  void ThreadView::on_search_done () {
+    /* the results may already have been collected, or the search
+     * cancelled, before the dispatcher was handled */
+    if (!search_t.joinable ()) return;
+
+    search_t.join ();
+
+    search_hits = search_results;
+    search_results.clear ();
+
+    LOG (debug) << "tv: search: " << search_hits.size () << " matches for: " << search_q;
+
+    if (search_hits.empty ()) return;
+
+    /* only expand the messages that have matches, these should be closed
+     * - except the focused one - when a search is cancelled */
+    refptr<Message> last;
+    for (auto &h : search_hits) {
+      if (h.message != last) {
+        state[h.message].search_expanded = !expand (h.message);
+        last = h.message;
+      }
+    }
+
+    /* highlight the matches in the expanded messages, the current match
+     * is selected by focus_search_hit () */
     WebKitFindController * f = webkit_web_view_get_find_controller (webview);
-    webkit_find_controller_search_next (f);
-    page_client->update_focus_to_view ();
+
+    webkit_find_controller_search (f, search_q.c_str (),
+        WEBKIT_FIND_OPTIONS_CASE_INSENSITIVE |
+        WEBKIT_FIND_OPTIONS_WRAP_AROUND,
+        0);
+
+    search_hit = 0;
+    focus_search_hit ();
+  }
+
+  void ThreadView::focus_search_hit () {
+    SearchHit & h = search_hits[search_hit];
+
+    /* focus the part with the match if it is focusable on its own,
+     * otherwise the message */
+    unsigned int e = 0;
+    auto & elements = state[h.message].elements;
+
+    for (unsigned int i = 0; i < elements.size (); i++) {
+      if (elements[i].type == MessageState::ElementType::Part &&
+          elements[i].id == h.chunk_id && elements[i].focusable) {
+        e = i;
+        break;
+      }
+    }
+
+    focused_message = h.message;
+    focus_element (h.message, e);
+
+    /* select the match within its part */
+    page_client->select_search_match (h.message, h.chunk_id, search_q, h.index);
+  }
+
+  void ThreadView::next_search_match () {
+    if (!in_search || search_hits.empty ()) return;
+
+    search_hit = (search_hit + 1) % search_hits.size ();
+    focus_search_hit ();
   }
 
   void ThreadView::prev_search_match () {
-    if (!in_search) return;
+    if (!in_search || search_hits.empty ()) return;
 
-    WebKitFindController * f = webkit_web_view_get_find_controller (webview);
-    webkit_find_controller_search_previous (f);
-    page_client->update_focus_to_view ();
+    search_hit = (search_hit + search_hits.size () - 1) % search_hits.size ();
+    focus_search_hit ();
   }
 
   /***************
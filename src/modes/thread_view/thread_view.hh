@@ -7,6 +7,7 @@
 # include <chrono>
 # include <mutex>
 # include <condition_variable>
+# include <thread>
 # include <functional>
 
 # include <gtkmm.h>
@@ -36,6 +37,10 @@ namespace Astroid {
       WebKitPolicyDecisionType decision_type,
       gpointer user_data);
 
+  extern "C" void ThreadView_on_part_request (
+      WebKitURISchemeRequest * request,
+      gpointer user_data);
+
   class ThreadView : public Mode {
     friend PageClient;
 
@@ -63,6 +68,7 @@ namespace Astroid {
       ustring home_uri;           // relative url for requests
 
       bool    expand_flagged;
+      bool    lazy_render;
 
       Theme theme;
 
@@ -108,6 +114,10 @@ namespace Astroid {
           bool marked           = false;
           bool unread_checked   = false;
 
+          /* only the header has been rendered, the body is rendered
+           * when the message is expanded */
+          bool stub             = false;
+
           enum ElementType {
             Empty = 0,
             Address,
@@ -168,6 +178,23 @@ namespace Astroid {
       WebKitSettings *    websettings;
       WebKitWebContext *  context;
 
+      /* context shared by all thread views (thread_view.shared_process) */
+      static WebKitWebContext * shared_context;
+      static WebKitWebContext * make_web_context (bool shared);
+
+      /* pool of thread views that have loaded their page and connected
+       * to their extension, refilled when idle (thread_view.preload_pool) */
+      static std::vector<ThreadView *> pool;
+      static sigc::connection pool_refill;
+      static bool refill_pool ();
+
+    public:
+      /* a pre-initialized thread view for the main window if one is
+       * available, otherwise a new one */
+      static ThreadView * take_from_pool (MainWindow *);
+      static void fill_pool ();
+      static void clear_pool ();
+
     protected:
       std::atomic<bool> wk_loaded;
 
@@ -177,7 +204,9 @@ namespace Astroid {
       void render_messages ();
 
       /* message loading and rendering */
-      void add_message (refptr<Message>);
+      void add_messages (std::vector<refptr<Message>> &);
+      void setup_message (refptr<Message>);
+      bool expand_by_default (refptr<Message>);
 
       bool open_html_part_external;
 
@@ -224,6 +253,46 @@ namespace Astroid {
       bool in_search = false;
       ustring search_q = "";
 
+      /* location of a match in the decoded text of a message part, the
+       * offset is in characters of the lower-cased text and index is the
+       * number of the match within the part. */
+      struct SearchHit {
+        refptr<Message> message;
+        int             chunk_id;
+        ustring_sz      offset;
+        int             index;
+      };
+
+      std::vector<SearchHit> search_hits;
+      int search_hit = -1;
+
+      /* copy of the still encoded content of a message part, made on the
+       * GUI thread so that the worker never touches the chunks. the
+       * worker decodes it and owns the stream. */
+      struct SearchText {
+        refptr<Message>       message;
+        int                   chunk_id;
+        GMimeStream *         content;
+        GMimeContentEncoding  encoding;
+        ustring               charset;
+        bool                  html;
+      };
+
+      /* the texts are searched on a worker thread which hands its
+       * results over through d_search_done */
+      std::thread             search_t;
+      std::atomic<bool>       search_cancel;
+      std::vector<SearchHit>  search_results;
+      Glib::Dispatcher        d_search_done;
+
+      void cancel_search ();
+      void search_texts (std::vector<SearchText> &, refptr<Message>, refptr<Chunk>);
+      void search_worker (ustring, std::vector<SearchText>);
+      static ustring search_decode (SearchText &);
+      static ustring html_to_text (ustring);
+      void on_search_done ();
+      void focus_search_hit ();
+
     public:
       /* the tv is ready */
       typedef sigc::signal <void> type_signal_ready;
@@ -5,6 +5,7 @@
 # include <string>
 # include <mutex>
 # include <iostream>
+# include <cstring>
 
 #ifdef ASTROID_WEBEXTENSION
 
@@ -34,44 +35,58 @@ namespace Astroid {
     "Mark",
     "Hidden",
     "ClearMessages",
-    "AddMessage",
     "UpdateMessage",
     "RemoveMessage",
+    "UpdateTags",
+    "AddMessages",
+    "SearchMatch",
   };
 
 
   void AeProtocol::send_message (
       MessageTypes mt,
       const ::google::protobuf::Message &m,
-      Glib::RefPtr<Gio::OutputStream> ostream)
+      Glib::RefPtr<Gio::OutputStream> ostream,
+      int id)
   {
-    std::string o;
-    gsize written = 0;
-    bool  s = false;
+    /* the message is serialized directly behind the frame header in a
+     * buffer that is re-used by this thread, and written in one go. */
+    thread_local std::vector<gchar> frame;
 
-    m.SerializeToString (&o);
+    FrameHeader h;
+    h.size = m.ByteSizeLong ();
+    h.type = mt;
+    h.id   = id;
 
-    /* send size of message */
-    gsize sz = o.size ();
-    s = ostream->write_all ((char*) &sz, sizeof(sz), written);
+    if (h.size > MAX_MESSAGE_SZ) {
+      LOG (error) << "ae: message exceeds maximum size: " << h.size;
+      throw ipc_error ("message exceeds maximum size.");
+    }
 
-    /* send message type */
-    s &= ostream->write_all ((char*) &mt, sizeof (mt), written);
+    frame.resize (sizeof (h) + h.size);
+    memcpy (frame.data (), &h, sizeof (h));
+    m.SerializeWithCachedSizesToArray ((::google::protobuf::uint8 *) frame.data () + sizeof (h));
+
+    gsize written = 0;
+    bool  s = false;
 
-    /* send message */
     try {
-      s &= ostream->write_all (o, written);
+      s = ostream->write_all (frame.data (), frame.size (), written);
     } catch (Gio::Error &ex) {
       LOG (error) << "ae: error: " << ex.what ();
       throw;
     }
-    ostream->flush ();
+
+    /* do not hold on to the memory of exceptionally large messages */
+    if (frame.capacity () > MAX_BUFFER_KEEP) {
+      std::vector<gchar> ().swap (frame);
+    }
 
     if (!s) {
       LOG (error) << "ae: could not write message!";
       throw ipc_error ("could not write message.");
     } else {
-      LOG (debug) << "ae: wrote: " << written << " of " << o.size () << " bytes.";
+      LOG (debug) << "ae: wrote: " << written << " bytes (message: " << h.size << " bytes).";
     }
   }
 
@@ -79,83 +94,54 @@ namespace Astroid {
       MessageTypes mt,
       const ::google::protobuf::Message &m,
       Glib::RefPtr<Gio::OutputStream> ostream,
-      std::mutex &m_ostream)
+      std::mutex &m_ostream,
+      int id)
   {
-    LOG (debug) << "ae: sending: " << MessageTypeStrings[mt];
+    LOG (debug) << "ae: sending: " << MessageTypeStrings[mt] << " (id: " << id << ")";
     LOG (debug) << "ae: send (async) waiting for lock";
     std::lock_guard<std::mutex> lk (m_ostream);
-    send_message (mt, m, ostream);
+    send_message (mt, m, ostream, id);
     LOG (debug) << "ae: send (async) message sent.";
   }
 
-  AstroidMessages::Ack AeProtocol::send_message_sync (
-      MessageTypes mt,
-      const ::google::protobuf::Message &m,
-      Glib::RefPtr<Gio::OutputStream> ostream,
-      std::mutex & m_ostream,
+  AeProtocol::MessageTypes AeProtocol::read_message (
       Glib::RefPtr<Gio::InputStream> istream,
-      std::mutex & m_istream)
+      Glib::RefPtr<Gio::Cancellable> reader_cancel,
+      std::vector<gchar> &buffer)
   {
-    LOG (debug) << "ae: sending: " << MessageTypeStrings[mt];
-    LOG (debug) << "ae: send (sync) waiting for lock..";
-    std::lock_guard<std::mutex> rlk (m_istream);
-    std::lock_guard<std::mutex> wlk (m_ostream);
-    LOG (debug) << "ae: send (sync) lock acquired.";
-
-    /* send message */
-    send_message (mt, m, ostream);
-
-    /* read response */
-    LOG (debug) << "ae: send (sync) waiting for ACK..";
-    AstroidMessages::Ack a;
-    a.set_success (false);
-
-    {
-      std::vector<gchar> msg_str;
-
-      auto mt = read_message (
-          istream,
-          Glib::RefPtr<Gio::Cancellable> (NULL),
-          msg_str);
-
-      /* parse message */
-      if (mt != AeProtocol::MessageTypes::Ack) {
-        LOG (debug) << "ae: reader: did not get Ack message back!";
-        return a;
-      }
-
-      LOG (debug) << "ae: send (sync) ACK received.";
-      a.ParseFromArray (msg_str.data(), msg_str.size());
-    }
-
-    return a;
+    int id;
+    return read_message (istream, reader_cancel, buffer, id);
   }
 
   AeProtocol::MessageTypes AeProtocol::read_message (
       Glib::RefPtr<Gio::InputStream> istream,
       Glib::RefPtr<Gio::Cancellable> reader_cancel,
-      std::vector<gchar> &buffer)
+      std::vector<gchar> &buffer,
+      int &id)
   {
     gsize read = 0;
     bool  s    = false;
 
-    /* read message size */
-    gsize msg_sz = 0;
-    s = istream->read_all ((char *) &msg_sz, sizeof (msg_sz), read, reader_cancel);
+    /* read frame header */
+    FrameHeader h;
+    s = istream->read_all ((char *) &h, sizeof (h), read, reader_cancel);
 
-    if (!s || read != sizeof (msg_sz)) {
-      throw ipc_error ("could not read message size");
+    if (!s || read != sizeof (h)) {
+      throw ipc_error ("could not read message header");
     }
 
+    gsize msg_sz = h.size;
+    AeProtocol::MessageTypes mt = h.type;
+    id = h.id;
+
     if (msg_sz > AeProtocol::MAX_MESSAGE_SZ) {
       throw ipc_error ("message exceeds maximum size.");
     }
 
-    AeProtocol::MessageTypes mt;
-    s = istream->read_all ((char*) &mt, sizeof (mt), read, reader_cancel);
-
-    if (!s || read != sizeof (mt)) {
-      throw ipc_error ("could not read message type");
+    /* the buffer is re-used by the caller, but do not hold on to the memory
+     * of exceptionally large messages */
+    if (buffer.capacity () > MAX_BUFFER_KEEP && msg_sz <= MAX_BUFFER_KEEP) {
+      std::vector<gchar> ().swap (buffer);
     }
 
     /* read message */
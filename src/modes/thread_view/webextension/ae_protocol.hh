@@ -25,33 +25,40 @@ namespace Astroid {
         Mark,
         Hidden,
         ClearMessages,
-        AddMessage,
         UpdateMessage,
         RemoveMessage,
+        UpdateTags,
+        AddMessages,
+        SearchMatch,
       } MessageTypes;
 
       static const char* MessageTypeStrings[];
       static const gsize MAX_MESSAGE_SZ = 200 * 1024 * 1024; // 200 MB
+      static const gsize MAX_BUFFER_KEEP = 4 * 1024 * 1024;  // 4 MB
 
+      /*
+       * every message is framed with its size, type and a request id. the
+       * receiver echoes the request id in the Ack (Ack.id) so that several
+       * requests may be in flight at the same time.
+       */
       static void send_message_async (
           MessageTypes mt,
           const ::google::protobuf::Message &m,
           Glib::RefPtr<Gio::OutputStream> ostream,
-          std::mutex &);
-
-      static AstroidMessages::Ack send_message_sync (
-          MessageTypes mt,
-          const ::google::protobuf::Message &m,
-          Glib::RefPtr<Gio::OutputStream> ostream,
-          std::mutex & m_ostream,
-          Glib::RefPtr<Gio::InputStream>  istream,
-          std::mutex & m_istream);
+          std::mutex &,
+          int id = 0);
 
       static MessageTypes read_message (
           Glib::RefPtr<Gio::InputStream> istream,
           Glib::RefPtr<Gio::Cancellable> reader_cancel,
           std::vector<gchar> &buffer);
 
+      static MessageTypes read_message (
+          Glib::RefPtr<Gio::InputStream> istream,
+          Glib::RefPtr<Gio::Cancellable> reader_cancel,
+          std::vector<gchar> &buffer,
+          int &id);
+
       /* exceptions */
       class ipc_error : public std::runtime_error {
         public:
@@ -59,10 +66,17 @@ namespace Astroid {
       };
 
     private:
+      struct FrameHeader {
+        gsize         size;
+        MessageTypes  type;
+        gint32        id;
+      };
+
       static void send_message (
           MessageTypes mt,
           const ::google::protobuf::Message &m,
-          Glib::RefPtr<Gio::OutputStream> ostream);
+          Glib::RefPtr<Gio::OutputStream> ostream,
+          int id);
   };
 }
 
@@ -49,12 +49,22 @@ web_page_created_callback (WebKitWebExtension *extension,
                            WebKitWebPage      *web_page,
                            gpointer            user_data )
 {
+  /* one extension instance per page, several pages may share this web
+   * process (thread_view.shared_process). */
+  AstroidExtension * ext = new AstroidExtension (extension, web_page, (const char *) user_data);
 
   g_signal_connect (web_page, "send-request",
       G_CALLBACK (web_page_send_request),
-      NULL);
+      ext);
 
-  ext->page_created (extension, web_page, user_data);
+  g_object_weak_ref (G_OBJECT (web_page), web_page_destroyed_callback, ext);
+}
+
+static void
+web_page_destroyed_callback (gpointer user_data,
+                             GObject * /* web_page */)
+{
+  delete ((AstroidExtension *) user_data);
 }
 
 bool web_page_send_request ( WebKitWebPage    *  web_page,
@@ -62,24 +72,27 @@ bool web_page_send_request ( WebKitWebPage    *  web_page,
                              WebKitURIResponse * response,
                              gpointer            user_data)
 {
-  return ext->send_request (web_page, request, response, user_data);
+  return ((AstroidExtension *) user_data)->send_request (web_page, request, response, NULL);
 }
 
 G_MODULE_EXPORT void
 webkit_web_extension_initialize_with_user_data (
     WebKitWebExtension *extension,
-    gpointer pipes)
+    gpointer gaddr)
 {
+  Glib::init ();
+  Gtk::Main::init_gtkmm_internals ();
+  Gio::init ();
+  logging::add_common_attributes ();
 
-  /* IMPORTANT: We assume that there will only be one extension instance
-   * per web page. That means that there can only be one page in each web view,
-   * and each web view must use its own process. */
-
-  ext = new AstroidExtension (extension, pipes);
+  /* the socket of each page is at the base address followed by the page id,
+   * the base address is kept for the lifetime of the process. */
+  gsize sz;
+  gchar * socket_base = g_strdup (g_variant_get_string ((GVariant *) gaddr, &sz));
 
   g_signal_connect (extension, "page-created",
       G_CALLBACK (web_page_created_callback),
-      NULL);
+      socket_base);
 }
 
 }/*}}}*/
@@ -120,14 +133,13 @@ void AstroidExtension::init_sys_log () {
 
 AstroidExtension::AstroidExtension (
     WebKitWebExtension * e,
-    gpointer gaddr)
+    WebKitWebPage * _page,
+    const char * socket_base)
 {
   extension = e;
+  page = _page;
 
-  Glib::init ();
-  Gtk::Main::init_gtkmm_internals ();
-  Gio::init ();
-  logging::add_common_attributes ();
+  reader_cancel = Gio::Cancellable::create ();
 
   /* load attachment icon */
   Glib::RefPtr<Gtk::IconTheme> theme = Gtk::IconTheme::get_default();
@@ -142,9 +154,8 @@ AstroidExtension::AstroidExtension (
       ATTACHMENT_ICON_WIDTH,
       Gtk::ICON_LOOKUP_USE_BUILTIN );
 
-  /* retrieve socket address */
-  gsize sz;
-  const char * caddr = g_variant_get_string ((GVariant *) gaddr, &sz);
+  /* socket address of this page */
+  ustring caddr = ustring::compose ("%1.%2", socket_base, webkit_web_page_get_id (page));
 
   refptr<Gio::UnixSocketAddress> addr = Gio::UnixSocketAddress::create (caddr,
       Gio::UNIX_SOCKET_ADDRESS_ABSTRACT);
@@ -171,19 +182,27 @@ AstroidExtension::~AstroidExtension () {
   run = false;
   if (reader_cancel)
     reader_cancel->cancel ();
-  reader_t.join ();
+  if (reader_t.joinable ())
+    reader_t.join ();
+
+  /* requests already queued on the main loop are dropped */
+  *alive = false;
 
 
   /* close connection */
-  sock->close ();
+  if (sock)
+    sock->close ();
 }
 
-void AstroidExtension::page_created (WebKitWebExtension * /* extension */,
-    WebKitWebPage * _page,
-    gpointer /* user_data */) {
+void AstroidExtension::on_idle (std::function<void ()> f) {
+  /* the page, and this extension, may be destroyed before the main loop
+   * gets to the request (thread_view.shared_process) */
+  std::shared_ptr<bool> a = alive;
 
-  page = _page;
-  LOG (debug) << "page created.";
+  Glib::signal_idle().connect_once (
+      [a, f] () {
+        if (*a) f ();
+      });
 }
 
 bool AstroidExtension::send_request (
@@ -224,6 +243,14 @@ void AstroidExtension::ack (bool success) {
   AstroidMessages::Ack m;
   m.set_success (success);
 
+  {
+    std::lock_guard<std::mutex> lk (m_requests);
+    if (!requests.empty ()) {
+      m.set_id (requests.front ());
+      requests.pop_front ();
+    }
+  }
+
   /* send back focus */
   m.mutable_focus ()->set_mid (focused_message);
   m.mutable_focus ()->set_element (focused_element);
@@ -235,18 +262,22 @@ void AstroidExtension::ack (bool success) {
 void AstroidExtension::reader () {/*{{{*/
   LOG (debug) << "reader thread: started.";
 
+  /* re-used for every message */
+  std::vector<gchar> buffer;
+
   while (run) {
     LOG (debug) << "reader waiting..";
 
-    std::vector<gchar> buffer;
     AeProtocol::MessageTypes mt;
+    int id;
 
     try {
 
       mt = AeProtocol::read_message (
           istream,
           reader_cancel,
-          buffer);
+          buffer,
+          id);
 
     } catch (AeProtocol::ipc_error &e) {
       LOG (warn) << "reader thread: " << e.what ();
@@ -254,6 +285,11 @@ void AstroidExtension::reader () {/*{{{*/
       break;
     }
 
+    {
+      std::lock_guard<std::mutex> lk (m_requests);
+      requests.push_back (id);
+    }
+
     /* parse message */
     switch (mt) {
       case AeProtocol::MessageTypes::Debug:
@@ -261,7 +297,12 @@ void AstroidExtension::reader () {/*{{{*/
           AstroidMessages::Debug m;
           m.ParseFromArray (buffer.data(), buffer.size());
           LOG (debug) << m.msg ();
-          ack (true);
+
+          /* ack in order with requests already queued */
+          on_idle (
+              [this] () {
+                ack (true);
+              });
         }
         break;
 
@@ -269,7 +310,7 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::Mark m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
                 sigc::mem_fun(*this, &AstroidExtension::handle_mark), m));
         }
@@ -279,7 +320,7 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::Hidden m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               [this,m] () {
                 set_hidden (m.mid (), m.hidden ());
                 ack (true);
@@ -291,7 +332,7 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::Focus m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
                 sigc::mem_fun(*this, &AstroidExtension::handle_focus), m));
         }
@@ -301,7 +342,7 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::State m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
                 sigc::mem_fun(*this, &AstroidExtension::handle_state), m));
         }
@@ -311,7 +352,7 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::Indent m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               [this,m] () {
                 set_indent (m.indent ());
                 ack (true);
@@ -323,7 +364,7 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::AllowRemoteImages m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               [this,m] () {
                 allow_remote_resources = true;
                 reload_images ();
@@ -336,7 +377,7 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::Page s;
           s.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
                 sigc::mem_fun(*this, &AstroidExtension::handle_page), s));
         }
@@ -346,19 +387,19 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::ClearMessage m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
                 sigc::mem_fun(*this, &AstroidExtension::clear_messages), m));
         }
         break;
 
-      case AeProtocol::MessageTypes::AddMessage:
+      case AeProtocol::MessageTypes::AddMessages:
         {
-          AstroidMessages::Message m;
+          AstroidMessages::AddMessages m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
-                sigc::mem_fun(*this, &AstroidExtension::add_message), m));
+                sigc::mem_fun(*this, &AstroidExtension::add_messages), m));
         }
         break;
 
@@ -366,17 +407,27 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::UpdateMessage m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
                 sigc::mem_fun(*this, &AstroidExtension::update_message), m));
         }
         break;
 
+      case AeProtocol::MessageTypes::UpdateTags:
+        {
+          AstroidMessages::UpdateTags m;
+          m.ParseFromArray (buffer.data(), buffer.size());
+          on_idle (
+              sigc::bind (
+                sigc::mem_fun(*this, &AstroidExtension::update_tags), m));
+        }
+        break;
+
       case AeProtocol::MessageTypes::RemoveMessage:
         {
           AstroidMessages::Message m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
                 sigc::mem_fun(*this, &AstroidExtension::remove_message), m));
         }
@@ -388,11 +439,11 @@ void AstroidExtension::reader () {/*{{{*/
           m.ParseFromArray (buffer.data(), buffer.size());
 
           if (m.warning ()) {
-            Glib::signal_idle().connect_once (
+            on_idle (
                 sigc::bind (
                   sigc::mem_fun(*this, &AstroidExtension::set_warning), m));
           } else {
-            Glib::signal_idle().connect_once (
+            on_idle (
                 sigc::bind (
                   sigc::mem_fun(*this, &AstroidExtension::set_info), m));
           }
@@ -403,14 +454,29 @@ void AstroidExtension::reader () {/*{{{*/
         {
           AstroidMessages::Navigate m;
           m.ParseFromArray (buffer.data(), buffer.size());
-          Glib::signal_idle().connect_once (
+          on_idle (
               sigc::bind (
                 sigc::mem_fun(*this, &AstroidExtension::handle_navigate), m));
         }
         break;
 
+      case AeProtocol::MessageTypes::SearchMatch:
+        {
+          AstroidMessages::SearchMatch m;
+          m.ParseFromArray (buffer.data(), buffer.size());
+          on_idle (
+              sigc::bind (
+                sigc::mem_fun(*this, &AstroidExtension::handle_search_match), m));
+        }
+        break;
+
       default:
-        break; // unknown message
+        {
+          /* unknown message, nothing will ack it */
+          std::lock_guard<std::mutex> lk (m_requests);
+          requests.pop_back ();
+        }
+        break;
     }
   }
 
@@ -418,13 +484,19 @@ void AstroidExtension::reader () {/*{{{*/
 }/*}}}*/
 
 void AstroidExtension::handle_page (AstroidMessages::Page &s) {/*{{{*/
-  /* set up logging */
-  if (s.use_stdout ()) {
-    init_console_log ();
-  }
+  /* set up logging, once for all pages in this process */
+  static bool log_initialized = false;
 
-  if (s.use_syslog ()) {
-    init_sys_log ();
+  if (!log_initialized) {
+    if (s.use_stdout ()) {
+      init_console_log ();
+    }
+
+    if (s.use_syslog ()) {
+      init_sys_log ();
+    }
+
+    log_initialized = true;
   }
 
   if (s.disable_log ()) {
@@ -457,8 +529,8 @@ void AstroidExtension::handle_page (AstroidMessages::Page &s) {/*{{{*/
   webkit_dom_node_append_child (WEBKIT_DOM_NODE(head), WEBKIT_DOM_NODE(e), (err = NULL, &err));
   LOG (debug) << "done";
 
-  /* store part / iframe css for later */
-  part_css = s.part_css ();
+  /* store uri of part / iframe css for later */
+  part_css_uri = s.part_css_uri ();
 
   /* store allowed uris */
   for (auto &s : s.allowed_uris ()) {
@@ -517,7 +589,7 @@ void AstroidExtension::reload_images () {
                   LOG (debug) << "found matching attachment for CID.";
 
                   webkit_dom_element_set_attribute (ine, "src", "", (err = NULL, &err));
-                  webkit_dom_element_set_attribute (ine, "src", s->content().c_str (), (err = NULL, &err));
+                  webkit_dom_element_set_attribute (ine, "src", s->uri().c_str (), (err = NULL, &err));
 
                 } else {
                   LOG (warn) << "could not find matching attachment for CID.";
@@ -606,29 +678,15 @@ void AstroidExtension::clear_messages (AstroidMessages::ClearMessage &) {
 }
 
 // Message generation {{{
-void AstroidExtension::add_message (AstroidMessages::Message &m) {
-  LOG (debug) << "adding message: " << m.mid ();
-  messages[m.mid()] = m;
-
-  WebKitDOMDocument *d = webkit_web_page_get_dom_document (page);
-  WebKitDOMElement * container = DomUtils::get_by_id (d, "message_container");
-
+WebKitDOMHTMLElement * AstroidExtension::build_message_div (
+    WebKitDOMDocument * d,
+    AstroidMessages::Message &m)
+{
   ustring div_id = "message_" + m.mid();
 
-  WebKitDOMNode * insert_before = webkit_dom_node_get_last_child (
-      WEBKIT_DOM_NODE(container));
-
   WebKitDOMHTMLElement * div_message = DomUtils::make_message_div (d);
-
-  GError * err = NULL;
   webkit_dom_element_set_id (WEBKIT_DOM_ELEMENT (div_message), div_id.c_str());
 
-  /* insert message div */
-  webkit_dom_node_insert_before (WEBKIT_DOM_NODE(container),
-      WEBKIT_DOM_NODE(div_message),
-      insert_before,
-      (err = NULL, &err));
-
   set_message_html (m, div_message);
 
   /* insert mime messages */
@@ -644,15 +702,50 @@ void AstroidExtension::add_message (AstroidMessages::Message &m) {
   /* marked */
   load_marked_icon (div_message);
 
+  return div_message;
+}
+
+void AstroidExtension::add_messages (AstroidMessages::AddMessages &ms) {
+  LOG (debug) << "adding messages: " << ms.messages_size ();
+
+  WebKitDOMDocument *d = webkit_web_page_get_dom_document (page);
+  WebKitDOMElement * container = DomUtils::get_by_id (d, "message_container");
+
+  /* build all messages off-document and insert them at once so that the
+   * page is only laid out once. */
+  WebKitDOMDocumentFragment * fragment = webkit_dom_document_create_document_fragment (d);
+
+  GError * err = NULL;
+
+  for (auto &m : *ms.mutable_messages ()) {
+    LOG (debug) << "adding message: " << m.mid ();
+    messages[m.mid()] = m;
+
+    WebKitDOMHTMLElement * div_message = build_message_div (d, m);
+
+    webkit_dom_node_append_child (WEBKIT_DOM_NODE(fragment),
+        WEBKIT_DOM_NODE(div_message),
+        (err = NULL, &err));
+
+    g_object_unref (div_message);
+  }
+
+  WebKitDOMNode * insert_before = webkit_dom_node_get_last_child (
+      WEBKIT_DOM_NODE(container));
+
+  webkit_dom_node_insert_before (WEBKIT_DOM_NODE(container),
+      WEBKIT_DOM_NODE(fragment),
+      insert_before,
+      (err = NULL, &err));
 
   g_object_unref (insert_before);
-  g_object_unref (div_message);
+  g_object_unref (fragment);
   g_object_unref (container);
   g_object_unref (d);
 
-  LOG (debug) << "message added.";
+  LOG (debug) << "messages added.";
 
-  apply_focus (focused_message, focused_element); // in case we got focus before message was added.
+  apply_focus (focused_message, focused_element); // in case we got focus before messages were added.
 
   ack (true);
 }
@@ -698,22 +791,7 @@ void AstroidExtension::update_message (AstroidMessages::UpdateMessage &um) {
 
     GError * err = NULL;
 
-    WebKitDOMHTMLElement * div_message = DomUtils::make_message_div (d);
-    webkit_dom_element_set_id (WEBKIT_DOM_ELEMENT (div_message), div_id.c_str());
-    set_message_html (m, div_message);
-
-    /* insert mime messages */
-    if (!m.missing_content()) {
-      insert_mime_messages (m, div_message);
-    }
-
-    /* insert attachments */
-    if (!m.missing_content()) {
-      insert_attachments (m, div_message);
-    }
-
-    /* marked */
-    load_marked_icon (div_message);
+    WebKitDOMHTMLElement * div_message = build_message_div (d, m);
 
     webkit_dom_node_replace_child (WEBKIT_DOM_NODE(container), WEBKIT_DOM_NODE (div_message), WEBKIT_DOM_NODE (old_div_message), (err = NULL, &err));
 
@@ -730,6 +808,11 @@ void AstroidExtension::update_message (AstroidMessages::UpdateMessage &um) {
           return m.mid() == focused_message;
         });
 
+    /* the element state may have been rebuilt */
+    if (ms != state.messages().end () && focused_element >= ms->elements_size ()) {
+      focused_element = 0;
+    }
+
     if (!ms->elements(focused_element).focusable()) {
       /* find next or previous element */
 
@@ -765,10 +848,6 @@ void AstroidExtension::update_message (AstroidMessages::UpdateMessage &um) {
 
     apply_focus (focused_message, focused_element);
 
-  } else if (um.type () == AstroidMessages::UpdateMessage_Type_Tags) {
-    LOG (debug) << "updating message: " << m.mid () << " (tags only)";
-    message_render_tags (m, WEBKIT_DOM_HTML_ELEMENT(old_div_message));
-    message_update_css_tags (m, WEBKIT_DOM_HTML_ELEMENT(old_div_message));
   }
 
   g_object_unref (old_div_message);
@@ -778,6 +857,35 @@ void AstroidExtension::update_message (AstroidMessages::UpdateMessage &um) {
   ack (true);
 }
 
+void AstroidExtension::update_tags (AstroidMessages::UpdateTags &ut) {
+  LOG (debug) << "updating tags: " << ut.mid ();
+
+  auto mi = messages.find (ut.mid ());
+  if (mi == messages.end ()) {
+    LOG (warn) << "updating tags: message not loaded: " << ut.mid ();
+    ack (false);
+    return;
+  }
+
+  /* keep the stored message in sync so that later renders use the new tags */
+  AstroidMessages::Message &m = mi->second;
+  *m.mutable_tags () = ut.tags ();
+  m.set_tag_string (ut.tag_string ());
+
+  WebKitDOMDocument *d = webkit_web_page_get_dom_document (page);
+
+  ustring div_id = "message_" + m.mid();
+  WebKitDOMHTMLElement * div_message = WEBKIT_DOM_HTML_ELEMENT(webkit_dom_document_get_element_by_id (d, div_id.c_str()));
+
+  message_render_tags (m, div_message);
+  message_update_css_tags (m, div_message);
+
+  g_object_unref (div_message);
+  g_object_unref (d);
+
+  ack (true);
+}
+
 /* main message generation  */
 void AstroidExtension::set_message_html (
     AstroidMessages::Message m,
@@ -865,14 +973,21 @@ void AstroidExtension::set_message_html (
         ".header_container .preview" );
 
   if (m.missing_content()) {
+    ustring missing = m.error ().empty () ? "Message content is missing." : m.error ();
+    ustring missing_html = "<i>" + Glib::Markup::escape_text (missing) + "</i>";
+
     /* set preview */
-    webkit_dom_element_set_inner_html (WEBKIT_DOM_ELEMENT(preview), "<i>Message content is missing.</i>", (err = NULL, &err));
+    webkit_dom_element_set_inner_html (WEBKIT_DOM_ELEMENT(preview), missing_html.c_str (), (err = NULL, &err));
 
     /* set warning */
     AstroidMessages::Info i;
     i.set_mid (m.mid());
     i.set_set (true);
-    i.set_txt ("The message file is missing, only fields cached in the notmuch database are shown. Most likely your database is out of sync.");
+    if (m.error ().empty ()) {
+      i.set_txt ("The message file is missing, only fields cached in the notmuch database are shown. Most likely your database is out of sync.");
+    } else {
+      i.set_txt (m.error ());
+    }
 
     set_warning (i);
 
@@ -888,7 +1003,7 @@ void AstroidExtension::set_message_html (
 
     webkit_dom_element_set_inner_html (
         WEBKIT_DOM_ELEMENT(body_container),
-        "<i>Message content is missing.</i>",
+        missing_html.c_str (),
         (err = NULL, &err));
 
     webkit_dom_node_append_child (WEBKIT_DOM_NODE (span_body),
@@ -899,8 +1014,10 @@ void AstroidExtension::set_message_html (
 
   } else {
 
-    /* build message body */
-    create_message_part_html (m, m.root(), span_body);
+    /* build message body, stubs are rendered in full when expanded */
+    if (!m.stub ()) {
+      create_message_part_html (m, m.root(), span_body);
+    }
 
     /* preview */
     webkit_dom_element_set_inner_html (WEBKIT_DOM_ELEMENT(preview), m.preview().c_str(), (err = NULL, &err));
@@ -1049,7 +1166,17 @@ void AstroidExtension::create_body_part (
 
     vector<ustring> all_sig_errors;
 
-    if (c.is_signed ()) {
+    if (c.crypto_pending ()) {
+      if (c.is_encrypted ()) {
+        if (c.is_signed ()) enc_string = "<span class=\"header\">Signed and Encrypted.</span>";
+        else                enc_string = "<span class=\"header\">Encrypted.</span>";
+
+        enc_string += "Decrypting..";
+      } else {
+        sign_string = "<span class=\"header\">Verifying signature..</span>";
+      }
+
+    } else if (c.is_signed ()) {
 
       if (c.signature().verified()) {
         sign_string += "<span class=\"header\">Signature verification succeeded.</span>";
@@ -1062,7 +1189,7 @@ void AstroidExtension::create_body_part (
       }
     }
 
-    if (c.is_encrypted ()) {
+    if (c.is_encrypted () && !c.crypto_pending ()) {
       if (c.is_signed ()) enc_string = "<span class=\"header\">Signed and Encrypted.</span>";
       else                enc_string = "<span class=\"header\">Encrypted.</span>";
 
@@ -1098,11 +1225,16 @@ void AstroidExtension::create_body_part (
     WebKitDOMDOMTokenList * class_list =
       webkit_dom_element_get_class_list (WEBKIT_DOM_ELEMENT(body_container));
 
+    if (c.crypto_pending ()) {
+      DomUtils::switch_class (class_list_e, "crypto_pending", true);
+      DomUtils::switch_class (class_list, "crypto_pending", true);
+    }
+
     if (c.is_encrypted ()) {
       DomUtils::switch_class (class_list_e, "encrypted", true);
       DomUtils::switch_class (class_list, "encrypted", true);
 
-      if (!c.encryption().decrypted()) {
+      if (!c.encryption().decrypted() && !c.crypto_pending ()) {
         DomUtils::switch_class (class_list_e, "decrypt_failed", true);
         DomUtils::switch_class (class_list, "decrypt_failed", true);
       }
@@ -1112,7 +1244,7 @@ void AstroidExtension::create_body_part (
       DomUtils::switch_class (class_list_e, "signed", true);
       DomUtils::switch_class (class_list, "signed", true);
 
-      if (!c.signature().verified()) {
+      if (!c.signature().verified() && !c.crypto_pending ()) {
         DomUtils::switch_class (class_list_e, "verify_failed", true);
         DomUtils::switch_class (class_list, "verify_failed", true);
 
@@ -1143,7 +1275,7 @@ void AstroidExtension::create_body_part (
    * run this later on extension GUI thread in order to make sure that the "body part" has been
    * added to the document.
    */
-  Glib::signal_idle().connect_once (
+  on_idle (
       sigc::bind (
         sigc::mem_fun(*this, &AstroidExtension::set_iframe_src), message.mid(), c.sid(), body));
 
@@ -1175,10 +1307,12 @@ void AstroidExtension::set_iframe_src (ustring mid, ustring cid, ustring body) {
 
   /* it would probably be possible to mess up the style, but it should only affect the current frame content. this would anyway be possible. */
 
+  /* the part style sheet is loaded from the same uri by all parts so that it
+   * is only transferred and parsed once. */
   webkit_dom_element_set_attribute (WEBKIT_DOM_ELEMENT (iframe), "srcdoc",
       ustring::compose (
-        "<STYLE>%1</STYLE>%2",
-        part_css,
+        "<LINK rel=\"stylesheet\" href=\"%1\">%2",
+        part_css_uri,
         body ).c_str (),
       (err = NULL, &err));
 
@@ -1360,8 +1494,11 @@ void AstroidExtension::insert_attachments (
       WEBKIT_DOM_HTML_IMAGE_ELEMENT(
       DomUtils::select (WEBKIT_DOM_NODE (attachment_table), ".preview img"));
 
+    /* thumbnail is generated on request */
+    webkit_dom_element_set_attribute (WEBKIT_DOM_ELEMENT (img), "loading",
+        "lazy", (err = NULL, &err));
     webkit_dom_element_set_attribute (WEBKIT_DOM_ELEMENT (img), "src",
-        c.thumbnail().c_str(), &err);
+        c.thumbnail().c_str(), (err = NULL, &err));
 
     // add the attachment table
     webkit_dom_node_append_child (WEBKIT_DOM_NODE (attachment_container),
@@ -2219,6 +2356,131 @@ void AstroidExtension::scroll_to_element (ustring eid) {
   return;
 }
 
+void AstroidExtension::handle_search_match (AstroidMessages::SearchMatch &m) {
+  /* select the index'th match of the text in the part, the matches are
+   * counted the same way as in ThreadView::search_worker. */
+  LOG (debug) << "search match: " << m.mid () << ": " << m.sid () << ": " << m.index ();
+  GError * err = NULL;
+
+  WebKitDOMDocument * d = webkit_web_page_get_dom_document (page);
+  WebKitDOMElement * body_container = webkit_dom_document_get_element_by_id (d, m.sid ().c_str ());
+
+  if (body_container == NULL) {
+    LOG (warn) << "search match: could not find part: " << m.sid ();
+    ack (false);
+    return;
+  }
+
+  WebKitDOMHTMLElement * iframe = DomUtils::select (WEBKIT_DOM_NODE (body_container), ".body_iframe");
+  WebKitDOMDocument * iframe_d = webkit_dom_html_iframe_element_get_content_document (WEBKIT_DOM_HTML_IFRAME_ELEMENT (iframe));
+  WebKitDOMHTMLElement * b = iframe_d ? webkit_dom_document_get_body (iframe_d) : NULL;
+
+  if (b == NULL) {
+    /* the part has not been loaded yet, show it at least */
+    LOG (debug) << "search match: part not loaded: " << m.sid ();
+    webkit_dom_element_scroll_into_view_if_needed (body_container, true);
+
+    g_object_unref (iframe);
+    ack (false);
+    return;
+  }
+
+  /* collect the displayed text of the part */
+  std::vector<std::pair<WebKitDOMNode *, ustring>> nodes;
+  ustring text;
+
+  WebKitDOMTreeWalker * walker = webkit_dom_document_create_tree_walker (
+      iframe_d, WEBKIT_DOM_NODE (b), WEBKIT_DOM_NODE_FILTER_SHOW_TEXT,
+      NULL, false, (err = NULL, &err));
+
+  for (WebKitDOMNode * n = webkit_dom_tree_walker_next_node (walker); n != NULL;
+       n = webkit_dom_tree_walker_next_node (walker)) {
+
+    WebKitDOMElement * pe = webkit_dom_node_get_parent_element (n);
+    if (pe != NULL) {
+      gchar * tag = webkit_dom_element_get_tag_name (pe);
+      ustring t   = ustring (tag).lowercase ();
+      g_free (tag);
+
+      if (t == "script" || t == "style" || t == "title") continue;
+    }
+
+    gchar * v = webkit_dom_node_get_node_value (n);
+    ustring nt = UstringUtils::replace (v, "\u00a0", " ");
+    g_free (v);
+
+    nodes.push_back (std::make_pair (n, nt));
+    text += nt;
+  }
+
+  /* find the match */
+  ustring q = UstringUtils::replace (m.text (), "\u00a0", " ").lowercase ();
+  ustring t = text.lowercase ();
+
+  ustring::size_type o = t.find (q);
+  for (int i = 0; i < m.index () && o != ustring::npos; i++) {
+    o = t.find (q, o + q.size ());
+  }
+
+  bool found = (o != ustring::npos && !q.empty ());
+
+  if (found) {
+    /* map the character offsets to a node and its utf-16 offset */
+    auto locate = [&] (ustring::size_type pos, bool end, WebKitDOMNode ** node, glong * offset) {
+      for (auto &n : nodes) {
+        ustring::size_type sz = n.second.size ();
+
+        if (pos < sz || (end && pos == sz)) {
+          glong u = 0;
+          auto it = n.second.begin ();
+          for (ustring::size_type j = 0; j < pos; j++, it++) {
+            u += (*it > 0xffff) ? 2 : 1;
+          }
+
+          *node   = n.first;
+          *offset = u;
+          return;
+        }
+
+        pos -= sz;
+      }
+    };
+
+    WebKitDOMNode * sn = NULL, * en = NULL;
+    glong so = 0, eo = 0;
+
+    locate (o, false, &sn, &so);
+    locate (o + q.size (), true, &en, &eo);
+
+    WebKitDOMRange * range = webkit_dom_document_create_range (iframe_d);
+    webkit_dom_range_set_start (range, sn, so, (err = NULL, &err));
+    webkit_dom_range_set_end (range, en, eo, (err = NULL, &err));
+
+    WebKitDOMDOMWindow * w = webkit_dom_document_get_default_view (iframe_d);
+    WebKitDOMDOMSelection * sel = webkit_dom_dom_window_get_selection (w);
+
+    webkit_dom_dom_selection_remove_all_ranges (sel);
+    webkit_dom_dom_selection_add_range (sel, range);
+
+    /* scrolls the thread view as well */
+    WebKitDOMElement * pe = webkit_dom_node_get_parent_element (sn);
+    if (pe != NULL) webkit_dom_element_scroll_into_view_if_needed (pe, true);
+
+    g_object_unref (sel);
+    g_object_unref (w);
+    g_object_unref (range);
+
+  } else {
+    LOG (debug) << "search match: match not found in part: " << m.sid ();
+    webkit_dom_element_scroll_into_view_if_needed (body_container, true);
+  }
+
+  g_object_unref (walker);
+  g_object_unref (iframe);
+
+  ack (found);
+}
+
 void AstroidExtension::handle_navigate (AstroidMessages::Navigate &n) {
   std::string _t = AstroidMessages::Navigate_Type_descriptor ()->FindValueByNumber (n.type ())->name ();
   LOG (debug) << "navigating, type: " << _t;
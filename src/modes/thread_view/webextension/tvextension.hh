@@ -8,6 +8,9 @@
 # include <giomm/socket.h>
 # include <thread>
 # include <mutex>
+# include <deque>
+# include <memory>
+# include <functional>
 # include <boost/log/trivial.hpp>
 
 # include "messages.pb.h"
@@ -24,8 +27,11 @@ web_page_created_callback (WebKitWebExtension *extension,
                            WebKitWebPage      *web_page,
                            gpointer            user_data);
 
+static void
+web_page_destroyed_callback (gpointer user_data, GObject * web_page);
+
 G_MODULE_EXPORT void
-webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension, gpointer pipes);
+webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension, gpointer gaddr);
 
 bool web_page_send_request ( WebKitWebPage    *  web_page,
                              WebKitURIRequest *  request,
@@ -36,10 +42,9 @@ bool web_page_send_request ( WebKitWebPage    *  web_page,
 
 class AstroidExtension {
   public:
-    AstroidExtension (WebKitWebExtension *, gpointer);
+    AstroidExtension (WebKitWebExtension *, WebKitWebPage *, const char * socket_base);
     ~AstroidExtension ();
 
-    void page_created (WebKitWebExtension *, WebKitWebPage *, gpointer);
     bool send_request ( WebKitWebPage    *  web_page,
                         WebKitURIRequest *  request,
                         WebKitURIResponse * response,
@@ -63,6 +68,16 @@ class AstroidExtension {
     void        reader ();
     bool        run = true;
     refptr<Gio::Cancellable> reader_cancel;
+
+    /* run f on the main loop, unless the extension has been destroyed by
+     * then. the flag is only read and written on the main loop. */
+    std::shared_ptr<bool> alive = std::make_shared<bool> (true);
+    void on_idle (std::function<void ()> f);
+
+    /* ids of requests waiting to be acknowledged, in the order they were
+     * received. requests are handled in order on the main loop. */
+    std::mutex      m_requests;
+    std::deque<int> requests;
     void        ack (bool success);
 
     void init_console_log ();
@@ -82,7 +97,7 @@ class AstroidExtension {
     WebKitDOMNode * container;
 
     void handle_page (AstroidMessages::Page &s);
-    ustring part_css;
+    ustring part_css_uri;
     bool page_ready = false;
 
     bool allow_remote_resources = false;
@@ -109,9 +124,13 @@ class AstroidExtension {
     bool is_hidden (ustring);
     void set_hidden (ustring, bool);
 
-    void add_message (AstroidMessages::Message &m);
+    void add_messages (AstroidMessages::AddMessages &m);
     void remove_message (AstroidMessages::Message &m);
     void update_message (AstroidMessages::UpdateMessage &m);
+    void update_tags (AstroidMessages::UpdateTags &m);
+
+    WebKitDOMHTMLElement * build_message_div (WebKitDOMDocument * d,
+        AstroidMessages::Message &m);
 
     void set_message_html (AstroidMessages::Message m,
         WebKitDOMHTMLElement * div_message);
@@ -174,6 +193,8 @@ class AstroidExtension {
     void update_focus_to_view ();
     void scroll_to_element (ustring eid);
 
+    void handle_search_match (AstroidMessages::SearchMatch &m);
+
     void focus_next_element (bool force_change);
     void focus_previous_element (bool force_change);
 
@@ -187,5 +208,3 @@ class AstroidExtension {
     void handle_navigate (AstroidMessages::Navigate &);
 };
 
-AstroidExtension * ext;
-
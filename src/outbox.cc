@@ -0,0 +1,404 @@
+# include <algorithm>
+# include <set>
+# include <ctime>
+
+# include <boost/filesystem.hpp>
+# include <boost/property_tree/ptree.hpp>
+# include <boost/property_tree/json_parser.hpp>
+
+# include "astroid.hh"
+# include "outbox.hh"
+# include "config.hh"
+# include "compose_message.hh"
+# include "account_manager.hh"
+# include "utils/ustring_utils.hh"
+
+using namespace boost::filesystem;
+using boost::property_tree::ptree;
+
+namespace Astroid {
+  Outbox::Outbox () {
+    LOG (info) << "outbox: setting up.";
+
+    const ptree & config = astroid->config ("mail.outbox");
+    concurrency     = std::max (1, config.get<int> ("concurrency"));
+    max_attempts    = config.get<int> ("max_attempts");
+    retry_delay     = std::max (1, config.get<int> ("retry_delay"));
+    max_retry_delay = std::max (retry_delay, config.get<int> ("max_retry_delay"));
+
+    outbox_dir = astroid->standard_paths ().data_dir / path ("outbox");
+    state_dir  = outbox_dir / path ("state");
+
+    try {
+      for (auto d : { "tmp", "new", "cur", "state" }) {
+        create_directories (outbox_dir / path (d));
+      }
+    } catch (filesystem_error &ex) {
+      LOG (error) << "outbox: could not create outbox: " << ex.what ();
+    }
+
+    load ();
+
+    c_schedule = Glib::signal_timeout ().connect_seconds (
+        sigc::mem_fun (this, &Outbox::schedule), 10);
+
+    /* send queued messages left from the last session */
+    Glib::signal_idle ().connect_once ([&] () { schedule (); });
+  }
+
+  Outbox::~Outbox () {
+    close ();
+  }
+
+  void Outbox::close () {
+    c_schedule.disconnect ();
+
+    /* messages still waiting for mail.send_delay are left queued in the
+     * outbox and sent on the next start. */
+    std::set<ustring> postponed;
+    for (auto &a : active) {
+      if (a.second->cancel_delayed ()) {
+        LOG (info) << "outbox: postponing: " << a.first;
+        postponed.insert (a.first);
+      }
+    }
+
+    /* messages already given to sendmail are finished first. the main loop
+     * is not running anymore, so the result is handled here rather than
+     * through the message_sent signal. this must run before the action
+     * manager is closed so that sent messages are added to the db. */
+    while (!active.empty ()) {
+      auto a = active.begin ();
+      ustring id = a->first;
+
+      LOG (debug) << "outbox: waiting for: " << id;
+      a->second->wait_sent ();
+      a->second->add_sent_message ();
+
+      bool    result = a->second->message_sent_result;
+      bool    cancelled = a->second->cancelled ();
+      ustring error  = a->second->message_send_status_msg;
+
+      active.erase (a);
+
+      if (postponed.count (id)) {
+        auto e = entries.find (id);
+        if (e != entries.end ()) e->second.state = Entry::Queued;
+      } else {
+        sent (id, result, cancelled, error);
+      }
+    }
+  }
+
+  ustring Outbox::entry_id (ustring mid) {
+    /* the message id is used as file name */
+    return UstringUtils::replace (mid, "/", "_");
+  }
+
+  path Outbox::message_path (ustring id) {
+    return outbox_dir / path ("new") / path (id.c_str ());
+  }
+
+  path Outbox::state_path (ustring id) {
+    return state_dir / path ((id + ".json").c_str ());
+  }
+
+  void Outbox::load () {
+    try {
+      for (directory_iterator it (state_dir), end; it != end; ++it) {
+        if (it->path ().extension () != ".json") continue;
+
+        ustring id = it->path ().stem ().string ();
+
+        if (!is_regular_file (message_path (id))) {
+          LOG (warn) << "outbox: removing state without message: " << id;
+          boost::filesystem::remove (it->path ());
+          continue;
+        }
+
+        ptree pt;
+        try {
+          read_json (it->path ().string (), pt);
+        } catch (boost::property_tree::json_parser_error &ex) {
+          LOG (error) << "outbox: could not read state of: " << id << ": " << ex.what ();
+        }
+
+        Entry e;
+        e.id         = id;
+        e.account    = pt.get<std::string> ("account", "");
+        e.to         = pt.get<std::string> ("to", "");
+        e.subject    = pt.get<std::string> ("subject", "");
+        e.inreplyto  = pt.get<std::string> ("inreplyto", "");
+        e.attempts   = pt.get<int> ("attempts", 0);
+        e.next_try   = pt.get<std::time_t> ("next_try", 0);
+        e.last_error = pt.get<std::string> ("last_error", "");
+        e.state      = pt.get<bool> ("failed", false) ? Entry::Failed : Entry::Queued;
+
+        entries[id] = e;
+      }
+    } catch (filesystem_error &ex) {
+      LOG (error) << "outbox: could not load outbox: " << ex.what ();
+    }
+
+    LOG (info) << "outbox: " << entries.size () << " queued messages.";
+  }
+
+  bool Outbox::save (Entry & e) {
+    ptree pt;
+    pt.put ("account", e.account);
+    pt.put ("to", e.to);
+    pt.put ("subject", e.subject);
+    pt.put ("inreplyto", e.inreplyto);
+    pt.put ("attempts", e.attempts);
+    pt.put ("next_try", e.next_try);
+    pt.put ("last_error", e.last_error);
+    pt.put ("failed", e.state == Entry::Failed);
+
+    path tmp = outbox_dir / path ("tmp") / path ((e.id + ".json").c_str ());
+
+    try {
+      write_json (tmp.string (), pt);
+      rename (tmp, state_path (e.id));
+    } catch (std::exception &ex) {
+      LOG (error) << "outbox: could not save state of: " << e.id << ": " << ex.what ();
+      return false;
+    }
+
+    return true;
+  }
+
+  void Outbox::delete_entry (ustring id) {
+    boost::system::error_code ec;
+    boost::filesystem::remove (message_path (id), ec);
+    boost::filesystem::remove (state_path (id), ec);
+
+    entries.erase (id);
+  }
+
+  ComposeMessage * Outbox::send (std::unique_ptr<ComposeMessage> c) {
+    Entry e;
+    e.id        = entry_id (c->id);
+    e.account   = c->account->id;
+    e.to        = c->to;
+    e.subject   = c->subject;
+    e.inreplyto = c->inreplyto;
+    e.state     = Entry::Sending;
+    e.attempts  = 0;
+
+    /* the message is in the outbox before it is handed to sendmail, the
+     * state is written before the message appears in new/. a message that
+     * cannot be queued is not sent. */
+    path tmp = outbox_dir / path ("tmp") / path (e.id.c_str ());
+    bool queued = false;
+
+    try {
+      c->write (tmp.c_str ());
+
+      if (save (e)) {
+        rename (tmp, message_path (e.id));
+        queued = true;
+      }
+    } catch (filesystem_error &ex) {
+      LOG (error) << "outbox: could not queue message: " << ex.what ();
+    }
+
+    if (!queued) {
+      LOG (error) << "outbox: could not queue message: " << e.id << ", not sending.";
+
+      boost::system::error_code ec;
+      boost::filesystem::remove (tmp, ec);
+      boost::filesystem::remove (state_path (e.id), ec);
+
+      return NULL;
+    }
+
+    entries[e.id] = e;
+
+    /* sendmail reads the queued copy, rather than the message being
+     * serialized once more in memory */
+    c->send_file = message_path (e.id).c_str ();
+    LOG (info) << "outbox: queued: " << e.id;
+
+    ComposeMessage * cm = c.get ();
+    active[e.id] = std::move (c);
+
+    start (e.id, cm);
+
+    return cm;
+  }
+
+  void Outbox::start (ustring id, ComposeMessage * c) {
+    c->message_sent ().connect (
+        sigc::bind (sigc::mem_fun (this, &Outbox::on_sent), id));
+
+    c->send_threaded ();
+
+    emit_changed ();
+  }
+
+  void Outbox::on_sent (bool result, ustring id) {
+    auto a = active.find (id);
+    if (a == active.end ()) return;
+
+    bool cancelled = a->second->cancelled ();
+    ustring error  = a->second->message_send_status_msg;
+
+    /* the message is still emitting its signal, release it when idle */
+    ComposeMessage * c = a->second.release ();
+    active.erase (a);
+    Glib::signal_idle ().connect_once ([c] () { delete c; });
+
+    sent (id, result, cancelled, error);
+  }
+
+  void Outbox::sent (ustring id, bool result, bool cancelled, ustring error) {
+    bool dryrun = astroid->config ().get<bool> ("astroid.debug.dryrun_sending");
+
+    auto e = entries.find (id);
+    if (e == entries.end ()) return;
+
+    if (result || cancelled || dryrun) {
+      LOG (info) << "outbox: " << (result ? "sent" : "cancelled") << ": " << id;
+      delete_entry (id);
+
+    } else {
+      Entry & en = e->second;
+      en.attempts++;
+      en.last_error = error;
+
+      if (max_attempts > 0 && en.attempts >= max_attempts) {
+        LOG (error) << "outbox: giving up sending: " << id << " after " << en.attempts << " attempts.";
+        en.state = Entry::Failed;
+      } else {
+        /* retry_delay, doubled for each failed attempt */
+        int delay = retry_delay;
+        for (int i = 1; i < en.attempts && delay < max_retry_delay; i++) delay *= 2;
+        delay = std::min (delay, max_retry_delay);
+
+        LOG (warn) << "outbox: could not send: " << id << ", retrying in " << delay << " s.";
+        en.state    = Entry::Queued;
+        en.next_try = std::time (NULL) + delay;
+      }
+
+      save (en);
+    }
+
+    emit_changed ();
+  }
+
+  Account * Outbox::get_account (ustring id) {
+    for (Account &a : astroid->accounts->accounts) {
+      if (a.id == id) return &a;
+    }
+
+    return NULL;
+  }
+
+  int Outbox::sending_for (ustring account) {
+    return std::count_if (entries.begin (), entries.end (),
+        [&] (const std::pair<const ustring, Entry> &e) {
+          return e.second.state == Entry::Sending && e.second.account == account;
+        });
+  }
+
+  bool Outbox::schedule () {
+    std::time_t now = std::time (NULL);
+
+    for (auto &kv : entries) {
+      Entry & e = kv.second;
+
+      if (e.state == Entry::Queued && e.next_try <= now &&
+          sending_for (e.account) < concurrency) {
+        send_entry (e);
+      }
+    }
+
+    return true;
+  }
+
+  void Outbox::send_entry (Entry & e) {
+    Account * a = get_account (e.account);
+
+    if (a == NULL) {
+      LOG (error) << "outbox: no account: " << e.account << " for: " << e.id;
+      e.state = Entry::Failed;
+      e.last_error = "no account: " + e.account;
+      save (e);
+      emit_changed ();
+      return;
+    }
+
+    std::unique_ptr<ComposeMessage> c (new ComposeMessage ());
+
+    if (!c->load_queued (message_path (e.id).c_str ())) {
+      e.state = Entry::Failed;
+      e.last_error = "could not load message";
+      save (e);
+      emit_changed ();
+      return;
+    }
+
+    LOG (info) << "outbox: sending: " << e.id << " (attempt " << (e.attempts + 1) << ")";
+
+    c->account   = a;
+    c->id        = e.id;
+    c->to        = e.to;
+    c->subject   = e.subject;
+    c->inreplyto = e.inreplyto;
+    c->use_send_delay = false;
+    c->send_file = message_path (e.id).c_str ();
+
+    e.state = Entry::Sending;
+
+    ComposeMessage * cm = c.get ();
+    active[e.id] = std::move (c);
+
+    start (e.id, cm);
+  }
+
+  bool Outbox::remove (ustring id) {
+    id = entry_id (id);
+    auto e = entries.find (id);
+
+    if (e == entries.end ()) return true;
+    if (e->second.state == Entry::Sending) return false;
+
+    LOG (info) << "outbox: removing: " << id;
+    delete_entry (id);
+    emit_changed ();
+
+    return true;
+  }
+
+  void Outbox::retry (ustring id) {
+    auto e = entries.find (id);
+
+    if (e != entries.end () && e->second.state != Entry::Sending) {
+      e->second.state    = Entry::Queued;
+      e->second.next_try = 0;
+      e->second.attempts = 0;
+      save (e->second);
+
+      schedule ();
+    }
+  }
+
+  std::vector<Outbox::Entry> Outbox::get_entries () {
+    std::vector<Entry> es;
+
+    for (auto &kv : entries) {
+      es.push_back (kv.second);
+    }
+
+    return es;
+  }
+
+  Outbox::type_signal_changed Outbox::signal_changed () {
+    return m_signal_changed;
+  }
+
+  void Outbox::emit_changed () {
+    m_signal_changed.emit ();
+  }
+}
+
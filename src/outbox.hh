@@ -0,0 +1,99 @@
+# pragma once
+
+# include <map>
+# include <memory>
+# include <vector>
+# include <ctime>
+
+# include <boost/filesystem.hpp>
+
+# include "astroid.hh"
+# include "proto.hh"
+
+namespace bfs = boost::filesystem;
+
+namespace Astroid {
+  /* durable queue of outgoing messages.
+   *
+   * messages are written to a maildir (<data_dir>/outbox) before they
+   * are sent and only removed once sendmail has accepted them. failed
+   * messages are retried in the background with an increasing delay,
+   * with at most mail.outbox.concurrency messages being sent for each
+   * account at the time.
+   */
+  class Outbox : public sigc::trackable {
+    public:
+      Outbox ();
+      ~Outbox ();
+
+      void close ();
+
+      struct Entry {
+        enum State {
+          Queued = 0,
+          Sending,
+          Failed,     // gave up after mail.outbox.max_attempts
+        };
+
+        ustring id;
+        ustring account;
+        ustring to;
+        ustring subject;
+        ustring inreplyto;
+
+        State       state    = Queued;
+        int         attempts = 0;
+        std::time_t next_try = 0;
+        ustring     last_error;
+      };
+
+      /* queue a finalized message and start sending it, the outbox takes
+       * ownership of the message and keeps it until it has been sent.
+       * returns NULL (and drops the message) if it could not be queued. */
+      ComposeMessage * send (std::unique_ptr<ComposeMessage>);
+
+      /* remove a message (by message id) from the outbox, not possible
+       * while it is being sent */
+      bool remove (ustring id);
+      void retry (ustring id);
+
+      std::vector<Entry> get_entries ();
+
+      /* the outbox or the state of an entry changed */
+      typedef sigc::signal <void> type_signal_changed;
+      type_signal_changed signal_changed ();
+
+    private:
+      bfs::path outbox_dir;
+      bfs::path state_dir;
+
+      int  concurrency;
+      int  max_attempts;
+      int  retry_delay;     // s
+      int  max_retry_delay; // s
+
+      std::map<ustring, Entry> entries;
+      std::map<ustring, std::unique_ptr<ComposeMessage>> active;
+
+      void load ();
+      bool save (Entry &);
+      static ustring entry_id (ustring mid);
+      bfs::path message_path (ustring id);
+      bfs::path state_path (ustring id);
+      void delete_entry (ustring id);
+
+      Account * get_account (ustring id);
+      int sending_for (ustring account);
+
+      sigc::connection c_schedule;
+      bool schedule ();
+      void send_entry (Entry &);
+      void start (ustring id, ComposeMessage *);
+      void on_sent (bool result, ustring id);
+      void sent (ustring id, bool result, bool cancelled, ustring error);
+
+      void emit_changed ();
+      type_signal_changed m_signal_changed;
+  };
+}
+
@@ -1,16 +1,23 @@
 # include <mutex>
+# include <algorithm>
 # include <chrono>
 # include <sys/wait.h>
 
+# include <fstream>
+# include <sstream>
+# include <cstdio>
+
 # include <boost/filesystem.hpp>
 # include <glibmm/spawn.h>
 
 # include "astroid.hh"
 # include "poll.hh"
+# include "indexer.hh"
 # include "db.hh"
 # include "config.hh"
 # include "actions/action_manager.hh"
 # include "utils/vector_utils.hh"
+# include "utils/utils.hh"
 
 
 using namespace std;
@@ -18,15 +25,28 @@ using namespace boost::filesystem;
 
 namespace Astroid {
   const int Poll::DEFAULT_POLL_INTERVAL = 60;
+  const int Poll::REFRESH_BATCH = 100;
+  const int Poll::REFRESH_SLICE = 20;
+
   Poll::Poll (bool _auto_polling_enabled) {
     LOG (info) << "poll: setting up.";
 
+    refresh_generation = 0;
+
     auto_polling_enabled = _auto_polling_enabled;
 
     poll_state = false;
 
     poll_interval = astroid->config ().get<int> ("poll.interval");
     full_refresh  = astroid->config ().get<bool> ("poll.always_full_refresh");
+    watch_db       = astroid->config ().get<bool> ("poll.watch.database");
+    watch_maildirs = astroid->config ().get<bool> ("poll.watch.maildirs");
+    watch_debounce = astroid->config ().get<int> ("poll.watch.debounce");
+
+    std::string mf = astroid->config ().get<std::string> ("poll.metrics_file");
+    if (!mf.empty ()) {
+      metrics_file = Utils::expand (path (mf)).string ();
+    }
     LOG (debug) << "poll: interval: " << poll_interval;
 
     // check every 1 seconds if periodic poll has changed
@@ -49,9 +69,149 @@ namespace Astroid {
     } else {
       d_refresh.connect (sigc::mem_fun (this, &Poll::refresh_full));
     }
+
+    d_refresh_queue.connect (sigc::mem_fun (this, &Poll::on_refresh_queue));
+
+    setup_watches ();
+
+    if (astroid->config ().get<bool> ("poll.indexer.enable")) {
+      /* new mail is indexed as it arrives, poll.sh does not need to run
+       * `notmuch new` */
+      indexer = new Indexer ();
+      indexer->signal_indexed ().connect (sigc::mem_fun (this, &Poll::on_indexed));
+    }
   }
 
   void Poll::close () {
+    if (indexer) {
+      indexer->close ();
+      delete indexer;
+      indexer = NULL;
+    }
+
+    cancel_refresh ();
+    refresh_running = false;
+
+    c_watch_debounce.disconnect ();
+
+    for (auto &m : monitors) {
+      m->cancel ();
+    }
+
+    monitors.clear ();
+  }
+
+  void Poll::setup_watches () {
+    if (watch_db) {
+      {
+        Db db (Db::DbMode::DATABASE_READ_ONLY);
+        watch_revision = db.get_revision ();
+      }
+
+      path xapian = Db::path_db / path (".notmuch") / path ("xapian");
+
+      if (is_directory (xapian)) {
+        LOG (info) << "poll: watching database: " << xapian.c_str ();
+
+        auto m = Gio::File::create_for_path (xapian.c_str ())->monitor_directory ();
+        m->signal_changed ().connect (
+            sigc::bind (sigc::mem_fun (this, &Poll::on_watch_event), false));
+        monitors.push_back (m);
+
+      } else {
+        LOG (warn) << "poll: could not find database directory to watch: " << xapian.c_str ();
+      }
+    }
+
+    if (watch_maildirs) {
+      /* only new mail needs to be indexed, so only the new/ directories
+       * of the maildirs are watched. */
+      try {
+        for (recursive_directory_iterator it (Db::path_db), end; it != end; ++it) {
+          if (!is_directory (it->status ())) continue;
+
+          if (it->path ().filename () == ".notmuch") {
+            it.no_push ();
+            continue;
+          }
+
+          if (it->path ().filename () == "new") {
+            LOG (debug) << "poll: watching maildir: " << it->path ().c_str ();
+
+            auto m = Gio::File::create_for_path (it->path ().c_str ())->monitor_directory ();
+            m->signal_changed ().connect (
+                sigc::bind (sigc::mem_fun (this, &Poll::on_watch_event), true));
+            monitors.push_back (m);
+
+            it.no_push ();
+          }
+        }
+      } catch (filesystem_error &ex) {
+        LOG (error) << "poll: could not set up maildir watches: " << ex.what ();
+      }
+
+      LOG (info) << "poll: watching " << monitors.size () << " directories.";
+    }
+  }
+
+  void Poll::on_watch_event (
+      const refptr<Gio::File> &,
+      const refptr<Gio::File> &,
+      Gio::FileMonitorEvent ev,
+      bool maildir)
+  {
+    if (maildir) {
+      if (ev != Gio::FILE_MONITOR_EVENT_CREATED &&
+          ev != Gio::FILE_MONITOR_EVENT_MOVED_IN) return;
+
+      watch_maildir_changed = true;
+    } else {
+      if (ev != Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+          ev != Gio::FILE_MONITOR_EVENT_CREATED &&
+          ev != Gio::FILE_MONITOR_EVENT_MOVED_IN) return;
+    }
+
+    /* restart the debounce timer, the database is usually written in
+     * several steps */
+    c_watch_debounce.disconnect ();
+    c_watch_debounce = Glib::signal_timeout ().connect (
+        sigc::mem_fun (this, &Poll::on_watch_debounced), watch_debounce);
+  }
+
+  bool Poll::on_watch_debounced () {
+    if (watch_maildir_changed) {
+      /* new mail has to be indexed first, the poll refreshes the
+       * changed threads when it is done */
+      LOG (info) << "poll: new mail in maildirs, polling..";
+      watch_maildir_changed = false;
+      poll ();
+
+      return false;
+    }
+
+    if (m_dopoll.try_lock ()) {
+      LOG (debug) << "poll: database changed, refreshing since: " << watch_revision;
+
+      start_metrics ("watch");
+      before_poll_revision = watch_revision;
+
+      if (full_refresh) {
+        refresh_full ();
+
+        Db db (Db::DbMode::DATABASE_READ_ONLY);
+        watch_revision = db.get_revision ();
+      } else {
+        refresh_threads ();
+      }
+
+      m_dopoll.unlock ();
+
+    } else {
+      /* the running poll will refresh the threads when it is done */
+      LOG (debug) << "poll: database changed during poll.";
+    }
+
+    return false;
   }
 
   void Poll::start_polling () {
@@ -68,9 +228,11 @@ namespace Astroid {
 
       external_polling = true;
       set_poll_state (true);
+      start_metrics ("external");
 
       Db db (Db::DbMode::DATABASE_READ_ONLY);
       before_poll_revision = db.get_revision ();
+      poll_metrics->revision_before = before_poll_revision;
       LOG (debug) << "poll: revision before poll: " << before_poll_revision;
 
     } else {
@@ -147,11 +309,14 @@ namespace Astroid {
 
     if (m_dopoll.try_lock ()) {
 
+      start_metrics ("poll");
+
       {
         Db db (Db::DbMode::DATABASE_READ_ONLY);
         before_poll_revision = db.get_revision ();
       }
       LOG (debug) << "poll: revision before poll: " << before_poll_revision;
+      poll_metrics->revision_before = before_poll_revision;
 
       do_poll ();
 
@@ -178,6 +343,7 @@ namespace Astroid {
     if (!is_regular_file (poll_script_uri)) {
       LOG (error) << "poll: poll script does not exist or is not a regular file.";
 
+      finish_metrics (poll_metrics, "failed");
       m_dopoll.unlock ();
       set_poll_state (false);
       return;
@@ -196,11 +362,13 @@ namespace Astroid {
                         );
     } catch (Glib::SpawnError &ex) {
       LOG (error) << "poll: exception while running poll script: " <<  ex.what ();
+      finish_metrics (poll_metrics, "failed");
       set_poll_state (false);
       m_dopoll.unlock ();
       return;
     } catch (Glib::Error &ex) {
       LOG (error) << "poll: exception while running poll script: " <<  ex.what ();
+      finish_metrics (poll_metrics, "failed");
       set_poll_state (false);
       m_dopoll.unlock ();
       return;
@@ -246,6 +414,11 @@ namespace Astroid {
 
     LOG (info) << "poll: done (time: " << elapsed.count() << " s) (status: " << child_status << ")";
 
+    if (poll_metrics) {
+      poll_metrics->script_time   = elapsed.count ();
+      poll_metrics->script_status = child_status;
+    }
+
     pid = 0;
     set_poll_state (false);
 
@@ -303,6 +476,7 @@ namespace Astroid {
     if (m_dopoll.try_lock ()) {
       LOG (info) << "poll: refreshing threads since: " << before;
 
+      start_metrics ("refresh");
       before_poll_revision = before;
       if (before_poll_revision == 0) {
         refresh_full ();
@@ -321,50 +495,330 @@ namespace Astroid {
   void Poll::refresh_full () {
     LOG (info) << "poll: requesting full refresh..";
     astroid->actions->emit_refreshed ();
+
+    finish_metrics (poll_metrics);
   }
 
-  void Poll::refresh_threads () {
+  void Poll::on_indexed (unsigned long revision) {
+    if (m_dopoll.try_lock ()) {
+      start_metrics ("indexer");
+      before_poll_revision = revision;
 
+      if (full_refresh) {
+        refresh_full ();
+      } else {
+        refresh_threads ();
+      }
+
+      m_dopoll.unlock ();
+
+    } else {
+      /* the running poll will refresh the threads when it is done */
+      LOG (debug) << "poll: indexed during poll.";
+    }
+  }
+
+  void Poll::refresh_threads () {
     /* update all threads that have been changed */
+    unsigned long from = before_poll_revision;
+
+    if (watch_db && watch_revision > 0) {
+      /* changes by other clients since the last refresh may not have been
+       * refreshed yet, e.g. if they happened while a poll was running */
+      from = std::min (from, watch_revision);
+    }
+
+    if (refresh_running) {
+      /* the threads of the superseded refresh that have not been
+       * refreshed yet are included in the new one */
+      LOG (debug) << "poll: superseding refresh since: " << refresh_from;
+      from = std::min (from, refresh_from);
+    }
+
+    cancel_refresh ();
+
+    /* the superseded refresh is finished with the time spent on it so
+     * far, the rest of it is counted by the new one */
+    finish_metrics (refresh_metrics, "superseded");
+
+    if (!poll_metrics) start_metrics ("refresh");
+    refresh_metrics = std::move (poll_metrics);
+    refresh_metrics->revision_before = from;
+
+    refresh_running = true;
+    refresh_from    = from;
+
+    refresh_t = std::thread (&Poll::refresh_worker, this, from, refresh_generation.load ());
+  }
+
+  void Poll::cancel_refresh () {
+    refresh_generation++;
+
+    if (refresh_t.joinable ()) {
+      refresh_t.join ();
+    }
+
+    c_refresh_slice.disconnect ();
+
+    std::lock_guard<std::mutex> lk (m_refresh_queue);
+    refresh_queue.clear ();
+    refresh_collected = false;
+  }
+
+  void Poll::refresh_worker (unsigned long from, unsigned long generation) {
+    auto start = chrono::steady_clock::now ();
     Db db (Db::DbMode::DATABASE_READ_ONLY);
 
     unsigned long revnow = db.get_revision ();
     LOG (debug) << "poll: refreshing.. revision after poll: " << revnow;
 
-    if (revnow > before_poll_revision) {
+    std::vector<ustring> batch;
+    unsigned int total_threads = 0;
+
+    if (revnow > from) {
 
       ustring query = ustring::compose ("lastmod:%1..%2",
-          before_poll_revision,
+          from,
           revnow);
 
       notmuch_query_t * qry = notmuch_query_create (db.nm_db, query.c_str ());
 
-      unsigned int total_threads;
-      notmuch_status_t st = NOTMUCH_STATUS_SUCCESS;
-      st = notmuch_query_count_threads (qry, &total_threads);
-
-      LOG (info) << "poll: " << total_threads << " threads changed, updating..";
+      notmuch_threads_t * threads;
+      notmuch_thread_t  * thread;
+      notmuch_status_t st = notmuch_query_search_threads (qry, &threads);
 
-      if (st == NOTMUCH_STATUS_SUCCESS && total_threads > 0) {
-        notmuch_threads_t * threads;
-        notmuch_thread_t  * thread;
-        st = notmuch_query_search_threads (qry, &threads);
+      for (;
+           (st == NOTMUCH_STATUS_SUCCESS) && notmuch_threads_valid (threads);
+           notmuch_threads_move_to_next (threads)) {
 
-        for (;
-             (st == NOTMUCH_STATUS_SUCCESS) && notmuch_threads_valid (threads);
-             notmuch_threads_move_to_next (threads)) {
+        if (refresh_generation != generation) {
+          LOG (debug) << "poll: refresh superseded.";
+          break;
+        }
 
-          thread = notmuch_threads_get (threads);
+        thread = notmuch_threads_get (threads);
+        batch.push_back (ustring (notmuch_thread_get_thread_id (thread)));
+        notmuch_thread_destroy (thread);
+        total_threads++;
 
-          const char * t = notmuch_thread_get_thread_id (thread);
+        if (batch.size () >= static_cast<unsigned int> (REFRESH_BATCH)) {
+          std::lock_guard<std::mutex> lk (m_refresh_queue);
+          refresh_queue.insert (refresh_queue.end (), batch.begin (), batch.end ());
+          batch.clear ();
 
-          ustring tt (t);
-          astroid->actions->emit_thread_updated (&db, tt);
+          d_refresh_queue.emit ();
         }
       }
 
       notmuch_query_destroy (qry);
+    }
+
+    if (refresh_generation != generation) return;
+
+    LOG (info) << "poll: " << total_threads << " threads changed, updating..";
+
+    std::lock_guard<std::mutex> lk (m_refresh_queue);
+    refresh_queue.insert (refresh_queue.end (), batch.begin (), batch.end ());
+    refresh_collected = true;
+    refresh_revision  = revnow;
+    collected_threads = total_threads;
+    collect_time      = chrono::duration<double> (chrono::steady_clock::now () - start).count ();
+
+    d_refresh_queue.emit ();
+  }
+
+  void Poll::on_refresh_queue () {
+    if (refresh_running && !c_refresh_slice.connected ()) {
+      c_refresh_slice = Glib::signal_idle ().connect (
+          sigc::mem_fun (this, &Poll::refresh_slice));
+    }
+  }
+
+  bool Poll::refresh_slice () {
+    /* refresh queued threads until the time slice is used up, then
+     * yield to the main loop */
+    auto start = chrono::steady_clock::now ();
+    Db db (Db::DbMode::DATABASE_READ_ONLY);
+
+    while (true) {
+      ustring tid;
+
+      {
+        std::lock_guard<std::mutex> lk (m_refresh_queue);
+
+        if (refresh_queue.empty ()) {
+          if (refresh_collected) {
+            /* refresh done */
+            refresh_running   = false;
+            refresh_collected = false;
+            watch_revision = std::max (watch_revision, refresh_revision);
+
+            if (refresh_metrics) {
+              refresh_metrics->revision_after  = refresh_revision;
+              refresh_metrics->changed_threads = collected_threads;
+              refresh_metrics->collect_time    = collect_time;
+            }
+          }
+
+          break;
+        }
+
+        tid = refresh_queue.front ();
+        refresh_queue.pop_front ();
+      }
+
+      astroid->actions->emit_thread_updated (&db, tid);
+
+      chrono::duration<double, std::milli> elapsed = chrono::steady_clock::now () - start;
+      if (elapsed.count () >= REFRESH_SLICE) {
+        if (refresh_metrics) refresh_metrics->refresh_time += elapsed.count () / 1000.;
+        return true;
+      }
+    }
+
+    if (refresh_metrics) {
+      refresh_metrics->refresh_time += chrono::duration<double> (chrono::steady_clock::now () - start).count ();
+    }
+
+    if (!refresh_running) {
+      if (refresh_t.joinable ()) refresh_t.join ();
+      finish_metrics (refresh_metrics);
+    }
+
+    return false;
+  }
+
+  void Poll::start_metrics (ustring source) {
+    if (poll_metrics) {
+      /* the refresh of the earlier poll never started, its changes are
+       * refreshed by this one */
+      finish_metrics (poll_metrics, "superseded");
+    }
+
+    poll_metrics.reset (new PollMetrics ());
+    poll_metrics->source = source;
+    poll_metrics->start  = chrono::steady_clock::now ();
+  }
+
+  void Poll::record_listener (const char * name, double ms) {
+    if (refresh_metrics && refresh_running) {
+      refresh_metrics->listeners[name] += ms;
+    }
+  }
+
+  void Poll::finish_metrics (std::unique_ptr<PollMetrics> & metrics, ustring outcome) {
+    if (!metrics) return;
+
+    metrics->outcome    = outcome;
+    metrics->total_time = chrono::duration<double> (chrono::steady_clock::now () - metrics->start).count ();
+
+    LOG (info) << "poll: " << metrics->str ();
+
+    std::string j = metrics->json ();
+    LOG (debug) << "poll: metrics: " << j;
+
+    if (!metrics_file.empty ()) {
+      std::ofstream f (metrics_file, std::ios::app);
+
+      if (f.good ()) {
+        f << j << std::endl;
+      } else {
+        LOG (error) << "poll: could not write metrics to: " << metrics_file;
+      }
+    }
+
+    metrics.reset ();
+  }
+
+  ustring PollMetrics::str () {
+    std::ostringstream s;
+
+    s << source << ": ";
+    if (source == "poll") {
+      s << "script: " << script_time << " s (status: " << script_status << "), ";
+    }
+
+    s << "revision: " << revision_before << ".." << revision_after
+      << ", changed threads: " << changed_threads
+      << ", collect: " << collect_time << " s"
+      << ", refresh: " << refresh_time << " s"
+      << ", total: " << total_time << " s";
+
+    if (!outcome.empty ()) {
+      s << " (" << outcome << ")";
+    }
+
+    for (auto &l : listeners) {
+      s << ", " << l.first << ": " << l.second << " ms";
+    }
+
+    return s.str ();
+  }
+
+  static std::string json_string (std::string in) {
+    std::ostringstream s;
+    s << '"';
+
+    for (unsigned char c : in) {
+      switch (c) {
+        case '"':  s << "\\\""; break;
+        case '\\': s << "\\\\"; break;
+        case '\n': s << "\\n"; break;
+        case '\t': s << "\\t"; break;
+        default:
+          if (c < 0x20) {
+            char u[7];
+            snprintf (u, sizeof (u), "\\u%04x", c);
+            s << u;
+          } else {
+            s << c;
+          }
+      }
+    }
+
+    s << '"';
+    return s.str ();
+  }
+
+  std::string PollMetrics::json () {
+    /* one line per poll, numbers are written as json numbers */
+    std::ostringstream s;
+
+    s << "{"
+      << "\"source\":"          << json_string (source)
+      << ",\"outcome\":"        << json_string (outcome)
+      << ",\"script_time\":"    << script_time
+      << ",\"script_status\":"  << script_status
+      << ",\"revision_before\":" << revision_before
+      << ",\"revision_after\":" << revision_after
+      << ",\"changed_threads\":" << changed_threads
+      << ",\"collect_time\":"   << collect_time
+      << ",\"refresh_time\":"   << refresh_time
+      << ",\"total_time\":"     << total_time
+      << ",\"listeners\":{";
+
+    bool first = true;
+    for (auto &l : listeners) {
+      if (!first) s << ",";
+      first = false;
+
+      s << json_string (l.first) << ":" << l.second;
+    }
+
+    s << "}}";
+
+    return s.str ();
+  }
+
+  PollListenerTimer::PollListenerTimer (const char * _name) {
+    name = _name;
+    t0   = chrono::steady_clock::now ();
+  }
 
+  PollListenerTimer::~PollListenerTimer () {
+    if (astroid->poll) {
+      chrono::duration<double, std::milli> elapsed = chrono::steady_clock::now () - t0;
+      astroid->poll->record_listener (name, elapsed.count ());
     }
   }
 
@@ -3,12 +3,56 @@
 # include "astroid.hh"
 
 # include <thread>
+# include <atomic>
+# include <deque>
+# include <map>
+# include <string>
 # include <mutex>
 # include <condition_variable>
 # include <chrono>
+# include <vector>
+# include <memory>
 # include <glibmm/iochannel.h>
+# include <giomm/filemonitor.h>
 
 namespace Astroid {
+  /* timing and volume of the phases of a poll (or another refresh of
+   * changed threads), logged when the refresh is done */
+  struct PollMetrics {
+    ustring source;                   // poll, external, watch, indexer or refresh
+    ustring outcome;                  // empty when done, superseded or failed
+
+    double  script_time   = 0;        // s
+    int     script_status = 0;
+
+    unsigned long revision_before = 0;
+    unsigned long revision_after  = 0;
+    unsigned int  changed_threads = 0;
+
+    double  collect_time  = 0;        // s, querying changed threads (worker)
+    double  refresh_time  = 0;        // s, refreshing threads (gui thread)
+    double  total_time    = 0;        // s, from start until refresh done
+
+    std::map<std::string, double> listeners; // ms spent in each listener
+
+    std::chrono::time_point<std::chrono::steady_clock> start;
+
+    ustring str ();
+    std::string json ();
+  };
+
+  /* measures the time a listener of the thread changed signals spends
+   * handling a refresh */
+  class PollListenerTimer {
+    public:
+      PollListenerTimer (const char * name);
+      ~PollListenerTimer ();
+
+    private:
+      const char * name;
+      std::chrono::time_point<std::chrono::steady_clock> t0;
+  };
+
   class Poll : public sigc::trackable {
     public:
       Poll (bool auto_polling_enabled);
@@ -26,6 +70,9 @@ namespace Astroid {
       void refresh (unsigned long before);
       void cancel_poll ();
 
+      /* add time spent by a listener to the metrics of a refresh in progress */
+      void record_listener (const char * name, double ms);
+
     private:
       std::mutex m_dopoll;
 
@@ -43,6 +90,67 @@ namespace Astroid {
       void refresh_threads ();
       void refresh_full ();
 
+      /* the changed threads are collected on a worker thread and handed
+       * to the gui thread in batches, where they are refreshed in time
+       * slices. a new refresh supersedes one in progress. */
+      static const int REFRESH_BATCH; // threads per batch from the worker
+      static const int REFRESH_SLICE; // ms spent refreshing per idle slice
+
+      std::thread refresh_t;
+      std::atomic<unsigned long> refresh_generation;
+      bool refresh_running = false;
+      unsigned long refresh_from = 0;
+
+      std::mutex          m_refresh_queue;
+      std::deque<ustring> refresh_queue;
+      bool                refresh_collected = false;
+      unsigned long       refresh_revision  = 0;
+
+      Glib::Dispatcher d_refresh_queue;
+      sigc::connection c_refresh_slice;
+
+      /* each poll or refresh has its own metrics, they are handed from
+       * the poll to its refresh when it starts and finished when that
+       * refresh is done */
+      std::unique_ptr<PollMetrics> poll_metrics;    // refresh not started
+      std::unique_ptr<PollMetrics> refresh_metrics; // refresh in progress
+      std::string metrics_file;
+      void start_metrics (ustring source);
+      void finish_metrics (std::unique_ptr<PollMetrics> &, ustring outcome = "");
+
+      /* set by the worker, protected by m_refresh_queue */
+      unsigned int collected_threads = 0;
+      double       collect_time      = 0;
+
+      void refresh_worker (unsigned long from, unsigned long generation);
+      void on_refresh_queue ();
+      bool refresh_slice ();
+      void cancel_refresh ();
+
+      /* watch the database, and optionally the maildirs, for changes
+       * made by other clients between polls */
+      bool watch_db       = false;
+      bool watch_maildirs = false;
+      int  watch_debounce = 0; // ms
+
+      unsigned long watch_revision = 0; // last revision refreshed
+      bool watch_maildir_changed   = false;
+
+      std::vector<refptr<Gio::FileMonitor>> monitors;
+      sigc::connection c_watch_debounce;
+
+      void setup_watches ();
+      void on_watch_event (
+          const refptr<Gio::File> &,
+          const refptr<Gio::File> &,
+          Gio::FileMonitorEvent,
+          bool maildir);
+      bool on_watch_debounced ();
+
+      /* in-process indexing of the maildirs (poll.indexer.enable) */
+      Indexer * indexer = NULL;
+      void on_indexed (unsigned long revision);
+
       std::mutex  poll_cancel_m;
       std::condition_variable poll_cancel_cv;
 
@@ -23,15 +23,21 @@ namespace Astroid {
   class Account;
   //class Contacts;
   class Poll;
+  class Indexer;
   class PluginManager;
 
   /* message and thread */
   class Message;
   class MessageThread;
   class Chunk;
+  class Crypto;
+  class CryptoWorker;
+  class DecryptedCache;
+  class KeyCache;
 
   /* composing */
   class ComposeMessage;
+  class Outbox;
 
   /* actions */
   class ActionManager;
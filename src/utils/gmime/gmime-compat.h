@@ -43,6 +43,7 @@ void g_mime_message_add_mailbox (GMimeMessage * msg, GMimeAddressType, const cha
 
 # define g_mime_message_get_from(m) g_mime_message_get_sender(m)
 # define g_mime_parser_construct_message(p,f) g_mime_parser_construct_message(p)
+# define g_mime_parser_construct_part(p,f) g_mime_parser_construct_part(p)
 
 # define g_mime_stream_file_open(f,m,err) g_mime_stream_file_new_for_path(f,m)
 
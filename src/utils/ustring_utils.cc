@@ -73,6 +73,28 @@ namespace Astroid {
     return subject;
   }
 
+  Glib::ustring UstringUtils::erase (const Glib::ustring& subject, const Glib::ustring& search) {
+    /* work on the raw UTF-8 bytes, a valid UTF-8 needle can only match
+     * at character boundaries. */
+    const std::string & s = subject.raw ();
+    const std::string & n = search.raw ();
+
+    if (n.empty ()) return subject;
+
+    std::string out;
+    out.reserve (s.size ());
+
+    size_t pos = 0;
+    size_t found;
+    while ((found = s.find (n, pos)) != std::string::npos) {
+      out.append (s, pos, found - pos);
+      pos = found + n.size ();
+    }
+    out.append (s, pos, std::string::npos);
+
+    return out;
+  }
+
   Glib::ustring UstringUtils::unixify (const Glib::ustring subject) {
     /* replace CRs with newlines */
     Glib::ustring s = replace (subject, "\r\n", "\n");
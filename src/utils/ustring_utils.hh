@@ -12,6 +12,9 @@ namespace Astroid {
       static Glib::ustring replace (Glib::ustring subject, const Glib::ustring& search,
                           const Glib::ustring& replace);
 
+      /* removes all occurences of search in one pass */
+      static Glib::ustring erase (const Glib::ustring& subject, const Glib::ustring& search);
+
       static Glib::ustring unixify (const Glib::ustring subject);
 
       /* converts a byte array to a ustring */
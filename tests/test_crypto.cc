@@ -5,6 +5,7 @@
 # include "test_common.hh"
 # include "compose_message.hh"
 # include "crypto.hh"
+# include "chunk.hh"
 # include "message_thread.hh"
 # include "account_manager.hh"
 # include "db.hh"
@@ -342,6 +343,231 @@ BOOST_AUTO_TEST_SUITE(GPGEncryption)
     teardown ();
   }
 
+  BOOST_AUTO_TEST_CASE (deferred_decrypt)
+  {
+    using Astroid::ComposeMessage;
+    using Astroid::Account;
+    using Astroid::Message;
+    using Astroid::Chunk;
+    setup ();
+
+    Account a = astroid->accounts->accounts[0];
+    a.email = "gaute@astroidmail.bar";
+
+    ComposeMessage * c = new ComposeMessage ();
+    c->set_from (&a);
+    c->set_to ("astrid@astroidmail.bar");
+    c->encrypt =  true;
+    c->sign = false;
+
+    ustring bdy = "This is test: æøå.\n > testing\ntesting\n...";
+
+    c->body << bdy;
+
+    c->build ();
+    c->finalize ();
+    ustring fn = c->write_tmp ();
+
+    BOOST_CHECK_MESSAGE (c->encryption_success == true, "encryption should be successful");
+
+    delete c;
+
+    Message m (fn);
+
+    /* queue the decryption on the crypto workers */
+    Chunk::Options opts;
+    opts.defer_crypto = true;
+
+    refptr<Chunk> ch = refptr<Chunk> (new Chunk (g_mime_message_get_mime_part (m.message), opts));
+
+    BOOST_CHECK (ch->isencrypted);
+    BOOST_CHECK (ch->crypt->pending);
+    BOOST_CHECK (ch->kids.empty ());
+
+    bool done = false;
+    ch->signal_crypto_done ().connect ([&] () { done = true; });
+
+    ch->wait_for_crypto ();
+
+    BOOST_CHECK (done);
+    BOOST_CHECK (!ch->crypt->pending);
+    BOOST_CHECK (ch->crypt->decrypted);
+    BOOST_CHECK (ch->kids.size () == 1);
+
+    unlink (fn.c_str ());
+
+    teardown ();
+  }
+
+  BOOST_AUTO_TEST_CASE (decrypted_cache)
+  {
+    using Astroid::ComposeMessage;
+    using Astroid::Account;
+    using Astroid::Message;
+    using Astroid::Crypto;
+    setup ();
+
+    astroid->decrypted_cache->enabled = true;
+
+    Account a = astroid->accounts->accounts[0];
+    a.email = "gaute@astroidmail.bar";
+
+    ComposeMessage * c = new ComposeMessage ();
+    c->set_from (&a);
+    c->set_to ("astrid@astroidmail.bar");
+    c->encrypt =  true;
+    c->sign = false;
+
+    ustring bdy = "This is test: æøå.\n > testing\ntesting\n...";
+
+    c->body << bdy;
+
+    c->build ();
+    c->finalize ();
+    ustring fn = c->write_tmp ();
+
+    BOOST_CHECK_MESSAGE (c->encryption_success == true, "encryption should be successful");
+
+    delete c;
+
+    Message m (fn);
+    GMimeObject * part = g_mime_message_get_mime_part (m.message);
+
+    ustring key = "test-mid/0";
+    BOOST_CHECK (!astroid->decrypted_cache->contains (key));
+
+    refptr<Crypto> cr1 = refptr<Crypto> (new Crypto ("application/pgp-encrypted"));
+    GMimeObject * d1 = cr1->decrypt_and_verify (part, key);
+    BOOST_CHECK (d1 != NULL);
+    BOOST_CHECK (astroid->decrypted_cache->contains (key));
+
+    /* second decryption is served from the cache */
+    refptr<Crypto> cr2 = refptr<Crypto> (new Crypto ("application/pgp-encrypted"));
+    GMimeObject * d2 = cr2->decrypt_and_verify (part, key);
+    BOOST_CHECK (d2 != NULL);
+    BOOST_CHECK (cr2->decrypted);
+
+    ustring s1 (g_mime_object_to_string (d1, NULL));
+    ustring s2 (g_mime_object_to_string (d2, NULL));
+    BOOST_CHECK (s1 == s2);
+
+    astroid->decrypted_cache->clear ();
+    BOOST_CHECK (!astroid->decrypted_cache->contains (key));
+
+    g_object_unref (d1);
+    g_object_unref (d2);
+
+    unlink (fn.c_str ());
+
+    teardown ();
+  }
+
+  BOOST_AUTO_TEST_CASE (signature_cache)
+  {
+    using Astroid::ComposeMessage;
+    using Astroid::Account;
+    using Astroid::Message;
+    using Astroid::Crypto;
+    using Astroid::SignatureCache;
+    setup ();
+
+    Account a = astroid->accounts->accounts[0];
+    a.email = "gaute@astroidmail.bar";
+
+    ComposeMessage * c = new ComposeMessage ();
+    c->set_from (&a);
+    c->set_to ("who@astroidmail.bar");
+    c->encrypt = false;
+    c->sign = true;
+
+    c->body << "This is a signed test.";
+
+    c->build ();
+    c->finalize ();
+    ustring fn = c->write_tmp ();
+
+    BOOST_CHECK_MESSAGE (c->encryption_success == true, "signing should be successful");
+
+    delete c;
+
+    Message m (fn);
+    GMimeObject * part = g_mime_message_get_mime_part (m.message);
+
+    /* verified while loading the message */
+    ustring key = SignatureCache::get_key (part);
+    GMimeSignatureList * cached = SignatureCache::load (key);
+    BOOST_REQUIRE (cached != NULL);
+    BOOST_CHECK (g_mime_signature_list_length (cached) == 1);
+
+    /* verification result is the same when read from the cache */
+    refptr<Crypto> cr = refptr<Crypto> (new Crypto ("application/pgp-signature"));
+    BOOST_CHECK (cr->verify_signature (part) == m.root->crypt->verified);
+
+    GMimeSignature * s = g_mime_signature_list_get_signature (cached, 0);
+    GMimeCertificate * ce = g_mime_signature_get_certificate (s);
+    GMimeSignature * s2 = g_mime_signature_list_get_signature (cr->slist, 0);
+    GMimeCertificate * ce2 = g_mime_signature_get_certificate (s2);
+
+    BOOST_CHECK (ustring (g_mime_certificate_get_key_id (ce)) == ustring (g_mime_certificate_get_key_id (ce2)));
+
+    g_object_unref (cached);
+
+    unlink (fn.c_str ());
+
+    teardown ();
+  }
+
+  BOOST_AUTO_TEST_CASE (key_cache)
+  {
+    using Astroid::ComposeMessage;
+    using Astroid::Account;
+    setup ();
+
+    astroid->key_cache->clear ();
+
+    Account a = astroid->accounts->accounts[0];
+    a.email = "gaute@astroidmail.bar";
+
+    BOOST_CHECK (!astroid->key_cache->contains ("astrid@astroidmail.bar"));
+
+    for (int i = 0; i < 2; i++) {
+      /* the second time the keys are taken from the cache */
+      ComposeMessage * c = new ComposeMessage ();
+      c->set_from (&a);
+      c->set_to ("astrid@astroidmail.bar");
+      c->set_cc ("gaute@astroidmail.bar");
+      c->encrypt = true;
+
+      c->body << "This is a test of the key cache.";
+
+      c->build ();
+      c->finalize ();
+
+      BOOST_CHECK_MESSAGE (c->encryption_success == true, "encryption should be successful");
+
+      BOOST_CHECK (astroid->key_cache->contains ("astrid@astroidmail.bar"));
+      BOOST_CHECK (astroid->key_cache->contains ("Gaute@astroidmail.bar"));
+
+      delete c;
+    }
+
+    /* only user ids with exactly the address match */
+    ustring gpgpath = astroid->config ().get<std::string> ("crypto.gpg.path");
+    auto keys = astroid->key_cache->resolve (gpgpath, { "strid@astroidmail.bar" });
+    BOOST_CHECK (keys.count ("strid@astroidmail.bar") == 0);
+
+    /* addresses without keys are cached as well */
+    BOOST_CHECK (astroid->key_cache->contains ("strid@astroidmail.bar"));
+
+    keys = astroid->key_cache->resolve (gpgpath, { "ASTRID@astroidmail.bar" });
+    BOOST_CHECK (keys["ASTRID@astroidmail.bar"].found);
+
+    astroid->key_cache->clear ();
+    BOOST_CHECK (!astroid->key_cache->contains ("astrid@astroidmail.bar"));
+
+    teardown ();
+  }
+
   BOOST_AUTO_TEST_CASE (crypto_md5)
   {
     using Astroid::Crypto;
@@ -75,6 +75,16 @@ BOOST_AUTO_TEST_SUITE(Generic)
     BOOST_CHECK (a == "n");
 
 
+    /* erase */
+    a = "<br>a<br><br>b<br>";
+    BOOST_CHECK (UstringUtils::erase (a, "<br>") == "ab");
+
+    a = "æø<br>å";
+    BOOST_CHECK (UstringUtils::erase (a, "<br>") == "æøå");
+
+    a = "abc";
+    BOOST_CHECK (UstringUtils::erase (a, "") == "abc");
+
     /* vector */
     a = "asd, bgd ,";
     auto v = VectorUtils::split_and_trim (a, ",");
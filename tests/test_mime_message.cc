@@ -32,6 +32,23 @@ BOOST_AUTO_TEST_SUITE(Reading)
     teardown ();
   }
 
+  BOOST_AUTO_TEST_CASE(reading_limited_plain_text)
+  {
+    setup ();
+
+    ustring fname = "tests/mail/test_mail/msg1.eml";
+
+    Message m (fname);
+
+    ustring full = m.plain_text (false);
+    ustring part = m.plain_text (false, 10);
+
+    BOOST_CHECK (part.size () <= 10);
+    BOOST_CHECK (full.substr (0, part.size ()) == part);
+
+    teardown ();
+  }
+
   BOOST_AUTO_TEST_CASE (write_mm_attachment_signature)
   {
     /* #237 and #239 */